@@ -0,0 +1,409 @@
+// LeastAverageImage
+// Andrew Eckel
+// bench.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+//The benchmark program, lai_bench (built and run by "make bench"). It lives outside src, since everything in src
+//makes up the program itself.
+//It makes synthetic frames of a given size, always from the same seed, and times each part of the program on them
+//separately: reading and writing PPM files, every difference function in every instruction set this processor
+//supports, offering scores to the rankings for several numbers of rankings, bicubic resampling, and rendering.
+//Every result is in megapixels per second, for the median (and the best) of several repeats, printed as a table
+//and, with --json, written to a JSON file, so that two builds (or two machines) can be compared by a script.
+//
+//Usage: lai_bench [--width W] [--height H] [--frames N] [--repeats R] [--threads T] [--dir D] [--json FILE]
+//The resampling uses a pool of --threads threads, like the program does; everything else is timed on one thread.
+//The PPM files are written to and read from --dir, and deleted afterwards.
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/ppm_functions.h"
+#include "../src/differencefunctions.h"
+#include "../src/differencerecord.h"
+#include "../src/outputrenderer.h"
+#include "../src/threadpool.h"
+#include "../src/utility.h"
+
+typedef struct
+{
+	int width, height, frames, repeats, threads;
+	std::string dir, json_filename;
+} BenchSettings;
+
+typedef struct
+{
+	std::string name, variant;
+	double megapixels; //Per repeat.
+	double median_mpix_per_s, best_mpix_per_s;
+} BenchResult;
+
+//Keeps the compiler from optimizing away work whose results are otherwise never used.
+static volatile unsigned long long sink;
+
+//A fixed seed, so every run works on exactly the same frames.
+static const unsigned int BENCH_SEED = 1;
+
+//Time run() settings.repeats times (after one untimed warm-up), where each run processes pixels pixels.
+//run() returns how many seconds to count, so it can leave its own setup out of the timing.
+static BenchResult measure(const BenchSettings &settings, const std::string &name, const std::string &variant,
+                           double pixels, const std::function<double()> &run)
+{
+	run();
+	std::vector<double> seconds;
+	for(int r = 0; r < settings.repeats; ++r){
+		seconds.push_back(run());
+	}
+	std::sort(seconds.begin(), seconds.end());
+	BenchResult result;
+	result.name = name;
+	result.variant = variant;
+	result.megapixels = pixels / 1e6;
+	result.median_mpix_per_s = result.megapixels / std::max(seconds[seconds.size() / 2], 1e-9);
+	result.best_mpix_per_s = result.megapixels / std::max(seconds[0], 1e-9);
+	std::cout << std::left << std::setw(40) << name << std::setw(20) << variant << std::right << std::fixed
+		<< std::setprecision(1) << std::setw(12) << result.median_mpix_per_s << std::setw(12) << result.best_mpix_per_s
+		<< std::endl;
+	return result;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//A smooth background that drifts a little from frame to frame, plus noise, so that the frames differ from their
+//average the way real ones do (mostly a little, sometimes a lot) and the rankings see a realistic mix of scores.
+static std::vector<Image> makeFrames(const BenchSettings &settings)
+{
+	std::mt19937 random(BENCH_SEED);
+	std::vector<Image> frames;
+	for(int f = 0; f < settings.frames; ++f){
+		Image img = createImageUninitialized(settings.height, settings.width);
+		int drift = (int) (random() % 32);
+		for(int i = 0; i < settings.height; ++i){
+			for(int j = 0; j < settings.width; ++j){
+				unsigned int noise = random();
+				int spike = ((noise >> 24) == 0) ? 128 : 0;
+				img.map[i][j].r = (unsigned char) ((i * 255 / settings.height + drift + (noise & 15) + spike) & 255);
+				img.map[i][j].g = (unsigned char) ((j * 255 / settings.width + ((noise >> 4) & 15) + spike) & 255);
+				img.map[i][j].b = (unsigned char) ((128 + drift + ((noise >> 8) & 31)) & 255);
+			}
+		}
+		frames.push_back(img);
+	}
+	return frames;
+}
+
+static Image averageOf(const std::vector<Image> &frames)
+{
+	Image avg = createImageUninitialized(frames[0].height, frames[0].width);
+	size_t pixels = (size_t) avg.height * avg.width;
+	for(size_t p = 0; p < pixels; ++p){
+		unsigned int r = 0, g = 0, b = 0;
+		for(size_t f = 0; f < frames.size(); ++f){
+			r += frames[f].data[p].r;
+			g += frames[f].data[p].g;
+			b += frames[f].data[p].b;
+		}
+		avg.data[p].r = (unsigned char) (r / frames.size());
+		avg.data[p].g = (unsigned char) (g / frames.size());
+		avg.data[p].b = (unsigned char) (b / frames.size());
+	}
+	return avg;
+}
+
+static const char *FUNCTION_NAMES[DifferenceFunctions::NUM_FUNCTIONS] = {
+	"Regular", "PerceivedBrightness", "ColorRatio", "InvertedColorRatio", "HalfInvertedColorRatio",
+	"InvertedEnumeratorColorRatio", "Combo", "Experiment"
+};
+
+static std::string precisionName(RankingBuffer::Precision precision)
+{
+	switch(precision){
+		case RankingBuffer::FLOAT_SCORES: return "float";
+		case RankingBuffer::QUANTIZED_SCORES: return "16bit";
+		default: return "double";
+	}
+}
+
+static bool writeJson(const BenchSettings &settings, const std::vector<BenchResult> &results)
+{
+	std::ofstream json(settings.json_filename);
+	if(!json){
+		return false;
+	}
+	json << "{\n  \"benchmark\": \"lai_bench\",\n  \"width\": " << settings.width << ",\n  \"height\": " << settings.height
+		<< ",\n  \"frames\": " << settings.frames << ",\n  \"repeats\": " << settings.repeats << ",\n  \"threads\": "
+		<< settings.threads << ",\n  \"seed\": " << BENCH_SEED << ",\n  \"best_instruction_set\": \""
+		<< DifferenceFunctions::instructionSetName(DifferenceFunctions::bestInstructionSet()) << "\",\n  \"results\": [\n";
+	json << std::setprecision(6);
+	for(size_t r = 0; r < results.size(); ++r){
+		json << "    {\"name\": \"" << results[r].name << "\", \"variant\": \"" << results[r].variant
+			<< "\", \"megapixels\": " << results[r].megapixels << ", \"median_mpix_per_s\": " << results[r].median_mpix_per_s
+			<< ", \"best_mpix_per_s\": " << results[r].best_mpix_per_s << "}" << ((r + 1 < results.size()) ? "," : "") << "\n";
+	}
+	json << "  ]\n}\n";
+	return (bool) json;
+}
+
+int main(int argc, char *argv[])
+{
+	BenchSettings settings;
+	settings.width = 1280;
+	settings.height = 720;
+	settings.frames = 8;
+	settings.repeats = 3;
+	settings.threads = 1;
+	settings.dir = ".";
+	for(int a = 1; a < argc; ++a){
+		std::string arg = argv[a];
+		if(a + 1 >= argc){
+			std::cerr << "ERROR: No value given for " << arg << "\n";
+			exit(1);
+		}
+		std::string value = argv[++a];
+		if(arg == "--width"){ settings.width = std::stoi(value); }
+		else if(arg == "--height"){ settings.height = std::stoi(value); }
+		else if(arg == "--frames"){ settings.frames = std::stoi(value); }
+		else if(arg == "--repeats"){ settings.repeats = std::stoi(value); }
+		else if(arg == "--threads"){ settings.threads = std::stoi(value); }
+		else if(arg == "--dir"){ settings.dir = value; }
+		else if(arg == "--json"){ settings.json_filename = value; }
+		else{
+			std::cerr << "ERROR: Unknown option " << arg << "\nUsage: lai_bench [--width W] [--height H] [--frames N] "
+				<< "[--repeats R] [--threads T] [--dir D] [--json FILE]\n";
+			exit(1);
+		}
+	}
+	if(settings.width < 8 || settings.height < 8 || settings.frames < 1 || settings.repeats < 1 || settings.threads < 0){
+		std::cerr << "ERROR: Invalid benchmark settings.\n";
+		exit(1);
+	}
+
+	ThreadPool pool(settings.threads);
+	settings.threads = pool.size();
+	std::cout << "LeastAverageImage benchmark: " << settings.frames << " frames of " << settings.width << " by "
+		<< settings.height << ", " << settings.repeats << " repeats, " << settings.threads << " thread(s)." << std::endl;
+	std::vector<Image> frames = makeFrames(settings);
+	Image average = averageOf(frames);
+	const int width = settings.width, height = settings.height;
+	const double frame_pixels = (double) width * height;
+	const double all_pixels = frame_pixels * settings.frames;
+	std::vector<BenchResult> results;
+
+	std::cout << std::endl << std::left << std::setw(40) << "component" << std::setw(20) << "variant" << std::right
+		<< std::setw(12) << "MPix/s" << std::setw(12) << "best" << std::endl;
+
+	//Files. These are read back from the OS's cache, so this is the cost of parsing and copying (or mapping), not the disk.
+	std::vector<std::string> filenames;
+	for(int f = 0; f < settings.frames; ++f){
+		filenames.push_back(Utility::endWithSlash(settings.dir) + "lai_bench_" + Utility::intToString(f, 3) + ".ppm");
+	}
+	results.push_back(measure(settings, "writeImage", "", all_pixels, [&](){
+		auto start = std::chrono::steady_clock::now();
+		for(int f = 0; f < settings.frames; ++f){
+			writeImage(frames[f], filenames[f]);
+		}
+		return secondsSince(start);
+	}));
+	results.push_back(measure(settings, "readImage", "", all_pixels, [&](){
+		auto start = std::chrono::steady_clock::now();
+		for(int f = 0; f < settings.frames; ++f){
+			Image img = readImage(filenames[f]);
+			//A mapped file isn't actually read until its pixels are, so every row is touched.
+			unsigned long long sum = 0;
+			for(int i = 0; i < img.height; ++i){
+				for(int j = 0; j < img.width; j += 16){
+					sum += img.map[i][j].g;
+				}
+			}
+			sink += sum;
+			deleteImage(img);
+		}
+		return secondsSince(start);
+	}));
+	for(int f = 0; f < settings.frames; ++f){
+		remove(filenames[f].c_str());
+	}
+
+	//Difference functions, one row at a time, like the differentiating phase.
+	std::vector<double> scores((size_t) DifferenceFunctions::NUM_FUNCTIONS * width);
+	const DifferenceFunctions::InstructionSet isas[] = { DifferenceFunctions::SCALAR, DifferenceFunctions::SSE41, DifferenceFunctions::AVX2 };
+	for(int id = 0; id < DifferenceFunctions::NUM_FUNCTIONS; ++id){
+		for(int s = 0; s < 3; ++s){
+			DifferenceFunctions::RowFunction row = DifferenceFunctions::rowFunction((DifferenceFunctions::FunctionId) id, isas[s]);
+			if(row == NULL){
+				continue;
+			}
+			results.push_back(measure(settings, std::string("difference_") + FUNCTION_NAMES[id],
+			                          DifferenceFunctions::instructionSetName(isas[s]), all_pixels, [&](){
+				auto start = std::chrono::steady_clock::now();
+				for(int f = 0; f < settings.frames; ++f){
+					for(int i = 0; i < height; ++i){
+						row(average.map[i], frames[f].map[i], &scores[0], width);
+					}
+				}
+				double seconds = secondsSince(start);
+				sink += (unsigned long long) scores[width / 2];
+				return seconds;
+			}));
+		}
+	}
+	//All of them at once, the way the program runs them.
+	double *fused_scores[DifferenceFunctions::NUM_FUNCTIONS];
+	for(int id = 0; id < DifferenceFunctions::NUM_FUNCTIONS; ++id){
+		fused_scores[id] = &scores[(size_t) id * width];
+	}
+	for(int s = 0; s < 3; ++s){
+		DifferenceFunctions::FusedRowFunction fused = DifferenceFunctions::fusedRowFunction(DifferenceFunctions::NUM_FUNCTION_SETS - 1, isas[s]);
+		if(fused == NULL){
+			continue;
+		}
+		results.push_back(measure(settings, "difference_AllFused", DifferenceFunctions::instructionSetName(isas[s]), all_pixels, [&](){
+			auto start = std::chrono::steady_clock::now();
+			for(int f = 0; f < settings.frames; ++f){
+				for(int i = 0; i < height; ++i){
+					fused(average.map[i], frames[f].map[i], fused_scores, width);
+				}
+			}
+			double seconds = secondsSince(start);
+			sink += (unsigned long long) scores[width / 2];
+			return seconds;
+		}));
+	}
+
+	//Offering scores to the rankings (the top-K update), with the Regular function's scores.
+	//Only the offers are timed; the scores are worked out beforehand, one frame at a time.
+	//Until the rankings are full, every offer gets in, which isn't what a long run mostly sees, so there are always at
+	//least twice as many offers as rankings: the frames are offered over and over, with their scores scaled
+	//differently (but always the same way) each time around.
+	std::vector<double> frame_scores((size_t) height * width);
+	DifferenceFunctions::RowFunction regular = DifferenceFunctions::rowFunction(DifferenceFunctions::REGULAR);
+	const int rankings_to_test[] = { 1, 3, 10, 40, 100 };
+	RankingBuffer rendered_rankings;
+	for(int k = 0; k < 5; ++k){
+		const int num_rankings = rankings_to_test[k];
+		const RankingBuffer::Precision precisions[] = { RankingBuffer::DOUBLE_SCORES, RankingBuffer::FLOAT_SCORES, RankingBuffer::QUANTIZED_SCORES };
+		for(int p = 0; p < 3; ++p){
+			//Every number of rankings with doubles, and the other precisions for one typical number.
+			if(p > 0 && num_rankings != 10){
+				continue;
+			}
+			RankingBuffer rankings;
+			const int offers = std::max(settings.frames, 2 * num_rankings);
+			results.push_back(measure(settings, "topK_offer", "K=" + Utility::intToString(num_rankings) + " "
+			                          + precisionName(precisions[p]), frame_pixels * offers, [&](){
+				rankings.allocate(height, width, num_rankings, precisions[p], DifferenceFunctions::scoreBound(DifferenceFunctions::REGULAR));
+				double seconds = 0.0;
+				for(int x = 0; x < offers; ++x){
+					const int f = x % settings.frames;
+					//Never more than the score bound, since the 16 bit scores depend on it.
+					const double scale = (x < settings.frames) ? 1.0 : 0.5 + 0.5 * ((x * 7919) % 101) / 101.0;
+					for(int i = 0; i < height; ++i){
+						double *row = &frame_scores[(size_t) i * width];
+						regular(average.map[i], frames[f].map[i], row, width);
+						for(int j = 0; j < width; ++j){
+							row[j] *= scale;
+						}
+					}
+					auto start = std::chrono::steady_clock::now();
+					for(int i = 0; i < height; ++i){
+						rankings.offerRow(rankings.pixelIndex(i, 0), &frame_scores[(size_t) i * width], frames[f].map[i], width, x);
+					}
+					seconds += secondsSince(start);
+				}
+				auto start = std::chrono::steady_clock::now();
+				rankings.finish(0, height);
+				return seconds + secondsSince(start);
+			}));
+			if(num_rankings == 10 && precisions[p] == RankingBuffer::DOUBLE_SCORES){
+				rendered_rankings = std::move(rankings);
+			}
+		}
+	}
+
+	//Resampling, measured in output pixels.
+	const int up_height = height * 3 / 2, up_width = width * 3 / 2;
+	const int down_height = height / 2, down_width = width / 2;
+	results.push_back(measure(settings, "resampleBicubic", "1.5x up", (double) up_height * up_width * settings.frames, [&](){
+		auto start = std::chrono::steady_clock::now();
+		for(int f = 0; f < settings.frames; ++f){
+			Image img = resampleBicubic(frames[f], up_height, up_width, &pool);
+			sink += img.data[0].r;
+			deleteImage(img);
+		}
+		return secondsSince(start);
+	}));
+	results.push_back(measure(settings, "resampleBicubic", "0.5x down", (double) down_height * down_width * settings.frames, [&](){
+		auto start = std::chrono::steady_clock::now();
+		for(int f = 0; f < settings.frames; ++f){
+			Image img = resampleBicubic(frames[f], down_height, down_width, &pool);
+			sink += img.data[0].r;
+			deleteImage(img);
+		}
+		return secondsSince(start);
+	}));
+	results.push_back(measure(settings, "resize_and_crop", "to square", (double) height * height * settings.frames, [&](){
+		auto start = std::chrono::steady_clock::now();
+		for(int f = 0; f < settings.frames; ++f){
+			Image img = resize_and_crop(frames[f], height, height, false, &pool);
+			sink += img.data[0].r;
+			deleteImage(img);
+		}
+		return secondsSince(start);
+	}));
+
+	//Rendering an output image from the rankings of the K=10 run.
+	DifferenceRecord dr;
+	dr.name = "Regular";
+	dr.function_id = DifferenceFunctions::REGULAR;
+	dr.invert_scores = false;
+	dr.rankings = std::move(rendered_rankings);
+	const int rankings_to_render[] = { 1, 10 };
+	const double powers_to_render[] = { 1.0, 12.0 };
+	for(int k = 0; k < 2; ++k){
+		for(int p = 0; p < 2; ++p){
+			OutputJob job;
+			job.dr = &dr;
+			job.num_rankings = rankings_to_render[k];
+			job.power = powers_to_render[p];
+			results.push_back(measure(settings, "renderOutput", "K=" + Utility::intToString(job.num_rankings) + " power "
+			                          + Utility::doubleToString(job.power, 0), frame_pixels, [&](){
+				auto start = std::chrono::steady_clock::now();
+				int equal_i, equal_j;
+				Image img = renderOutput(job, average, &equal_i, &equal_j);
+				double seconds = secondsSince(start);
+				sink += img.data[0].r;
+				deleteImage(img);
+				return seconds;
+			}));
+		}
+	}
+
+	for(int f = 0; f < settings.frames; ++f){
+		deleteImage(frames[f]);
+	}
+	deleteImage(average);
+
+	if(!settings.json_filename.empty()){
+		if(!writeJson(settings, results)){
+			std::cerr << "ERROR: Can't write " << settings.json_filename << "\n";
+			exit(1);
+		}
+		std::cout << std::endl << "Wrote " << settings.json_filename << std::endl;
+	}
+	return 0;
+}
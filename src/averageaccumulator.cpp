@@ -0,0 +1,188 @@
+// LeastAverageImage
+// Andrew Eckel
+// averageaccumulator.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#include "averageaccumulator.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <random>
+#include <stdlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//Add n bytes to n 32 bit totals.
+//Adding frames is limited by how fast the frames and totals can be read from memory, not by arithmetic,
+//so SSE2 (which every x86-64 processor has) is as fast as anything wider would be, without needing a separate
+//build of this file for each instruction set like the difference functions have.
+static void addBytes(uint32_t *totals, const unsigned char *bytes, size_t n)
+{
+	size_t v = 0;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	for(; v + 16 <= n; v += 16){
+		__m128i b = _mm_loadu_si128((const __m128i *) (bytes + v));
+		__m128i lo = _mm_unpacklo_epi8(b, zero);
+		__m128i hi = _mm_unpackhi_epi8(b, zero);
+		__m128i *t = (__m128i *) (totals + v);
+		_mm_storeu_si128(t, _mm_add_epi32(_mm_loadu_si128(t), _mm_unpacklo_epi16(lo, zero)));
+		_mm_storeu_si128(t + 1, _mm_add_epi32(_mm_loadu_si128(t + 1), _mm_unpackhi_epi16(lo, zero)));
+		_mm_storeu_si128(t + 2, _mm_add_epi32(_mm_loadu_si128(t + 2), _mm_unpacklo_epi16(hi, zero)));
+		_mm_storeu_si128(t + 3, _mm_add_epi32(_mm_loadu_si128(t + 3), _mm_unpackhi_epi16(hi, zero)));
+	}
+#endif
+	for(; v < n; ++v){
+		totals[v] += bytes[v];
+	}
+}
+
+AverageAccumulator::AverageAccumulator(int height, int width)
+{
+	this->height = height;
+	this->width = width;
+	narrow.resize((size_t) height * width * 3, 0);
+	narrow_frames = 0;
+}
+
+void AverageAccumulator::add(const Image &img, ThreadPool &pool)
+{
+	if(narrow_frames == MAX_NARROW_FRAMES){
+		widen();
+	}
+	const size_t row_values = (size_t) width * 3;
+	const unsigned char *raster = (const unsigned char *) img.data;
+	pool.parallelForBands(0, height, [&](int first_row, int last_row){
+		size_t first_value = first_row * row_values;
+		addBytes(&narrow[first_value], raster + first_value, (last_row - first_row) * row_values);
+	});
+	++narrow_frames;
+}
+
+void AverageAccumulator::widen()
+{
+	if(wide.empty()){
+		wide.resize(narrow.size(), 0);
+	}
+	for(size_t v = 0; v < narrow.size(); ++v){
+		wide[v] += narrow[v];
+		narrow[v] = 0;
+	}
+	narrow_frames = 0;
+}
+
+std::vector<unsigned long long> &AverageAccumulator::wideTotals()
+{
+	widen();
+	return wide;
+}
+
+Image AverageAccumulator::mean(int num_frames, ThreadPool &pool)
+{
+	Image result = createImageUninitialized(height, width);
+	unsigned char *mean = (unsigned char *) result.data;
+	const size_t row_values = (size_t) width * 3;
+	//round(total / n) is floor((2 * total + n) / (2 * n)). That's found with a multiply by the reciprocal of 2 * n,
+	//which can be one off either way, so it's checked and corrected with integer arithmetic to get it exactly right.
+	//(Totals are far below 2^62, so they're converted as signed numbers, which is quicker than unsigned.)
+	const long long divisor = 2LL * num_frames;
+	const double reciprocal = 1.0 / divisor;
+	const bool any_wide = !wide.empty();
+	pool.parallelForBands(0, height, [&](int first_row, int last_row){
+		for(size_t v = first_row * row_values; v < last_row * row_values; ++v){
+			long long total = narrow[v] + (any_wide ? (long long) wide[v] : 0);
+			long long dividend = 2 * total + num_frames;
+			long long q = (long long) ((double) dividend * reciprocal);
+			if(q * divisor > dividend){
+				--q;
+			}
+			else if((q + 1) * divisor <= dividend){
+				++q;
+			}
+			mean[v] = (unsigned char) q;
+		}
+	});
+	return result;
+}
+
+std::vector<int> sampleFrames(int num_frames, int sample_frames, bool random)
+{
+	std::vector<int> frames;
+	if(random){
+		//A partial Fisher-Yates shuffle with a fixed seed. (mt19937 gives the same numbers everywhere;
+		//the standard library's distributions and std::shuffle don't have to.)
+		std::mt19937 rng(1);
+		std::vector<int> all(num_frames);
+		for(int x = 0; x < num_frames; ++x){
+			all[x] = x;
+		}
+		for(int k = 0; k < sample_frames; ++k){
+			std::swap(all[k], all[k + rng() % (num_frames - k)]);
+		}
+		frames.assign(all.begin(), all.begin() + sample_frames);
+		std::sort(frames.begin(), frames.end());
+	}
+	else{
+		for(int k = 0; k < sample_frames; ++k){
+			frames.push_back((int) ((long long) k * num_frames / sample_frames));
+		}
+	}
+	return frames;
+}
+
+AverageErrorSampler::AverageErrorSampler(int height, int width)
+{
+	const int rows = (height < GRID_SIZE) ? height : GRID_SIZE;
+	const int columns = (width < GRID_SIZE) ? width : GRID_SIZE;
+	for(int a = 0; a < rows; ++a){
+		for(int b = 0; b < columns; ++b){
+			int i = (int) ((2LL * a + 1) * height / (2 * rows));
+			int j = (int) ((2LL * b + 1) * width / (2 * columns));
+			pixels.push_back((size_t) i * width + j);
+		}
+	}
+	totals.resize(pixels.size() * 3, 0);
+}
+
+void AverageErrorSampler::add(const Image &img)
+{
+	for(size_t p = 0; p < pixels.size(); ++p){
+		const Pixel &pixel = img.data[pixels[p]];
+		totals[3 * p] += pixel.r;
+		totals[3 * p + 1] += pixel.g;
+		totals[3 * p + 2] += pixel.b;
+	}
+}
+
+void AverageErrorSampler::report(const Image &approximate, int num_frames) const
+{
+	double total_error = 0.0;
+	int max_error = 0;
+	size_t off_by_more_than_one = 0;
+	for(size_t p = 0; p < pixels.size(); ++p){
+		const Pixel &pixel = approximate.data[pixels[p]];
+		const unsigned char values[3] = { pixel.r, pixel.g, pixel.b };
+		for(int c = 0; c < 3; ++c){
+			int exact = (int) ((2 * totals[3 * p + c] + num_frames) / (2ULL * num_frames));
+			int error = abs(values[c] - exact);
+			total_error += error;
+			max_error = std::max(max_error, error);
+			if(error > 1){
+				++off_by_more_than_one;
+			}
+		}
+	}
+	const size_t values_sampled = totals.size();
+	//Formatted on its own, so std::cout's precision is left as it was for everything printed after.
+	std::ostringstream line;
+	line << "Approximate average, compared to the exact average at " << pixels.size() << " pixels: mean error "
+		<< std::fixed << std::setprecision(2) << total_error / values_sampled << ", max error " << max_error << ", "
+		<< 100.0 * off_by_more_than_one / values_sampled << "% of values off by more than 1 (out of 255).";
+	std::cout << line.str() << std::endl;
+}
@@ -0,0 +1,72 @@
+// LeastAverageImage
+// Andrew Eckel
+// averageaccumulator.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef AVERAGEACCUMULATOR_H
+#define AVERAGEACCUMULATOR_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ppm_functions.h"
+#include "threadpool.h"
+
+//The running totals of the averaging phase: one per color channel of every pixel, in the same order as the values
+//in an image's raster, so a frame is added by walking both straight through.
+//Frames are added into 32 bit totals, which take half the memory bandwidth of 64 bit ones. 32 bits is enough for
+//16843009 frames of 255s, so before that many frames have gone into them, they are folded into 64 bit totals
+//(which are only allocated the first time that happens) and start over from zero. So any number of frames is safe.
+class AverageAccumulator
+{
+public:
+	AverageAccumulator(int height, int width);
+
+	//Add every value of img, which must be height by width, to the totals. The rows are split over the pool's threads.
+	void add(const Image &img, ThreadPool &pool);
+
+	//The totals divided by num_frames and rounded to the nearest integer (halves round up), as a new image.
+	Image mean(int num_frames, ThreadPool &pool);
+
+	//All the totals so far, folded into the 64 bit totals, for saving to and restoring from a checkpoint.
+	//They may be changed, as long as no frame is being added at the same time.
+	std::vector<unsigned long long> &wideTotals();
+
+	//The most frames that can be added to a 32 bit total before it might overflow.
+	static const unsigned int MAX_NARROW_FRAMES = 0xFFFFFFFFu / 255;
+
+private:
+	void widen();
+
+	int height, width;
+	std::vector<uint32_t> narrow;
+	std::vector<unsigned long long> wide;
+	unsigned int narrow_frames;
+};
+
+//The frames to average for an approximate reference: sample_frames of the num_frames frames, in increasing order.
+//Strided samples are spread evenly, starting with frame 0. Random samples always come out the same for the same numbers.
+std::vector<int> sampleFrames(int num_frames, int sample_frames, bool random);
+
+//Exact totals for a grid of pixels spread evenly over the image, for measuring how close an average made from
+//only some of the frames is to the exact average of all of them. Adding a frame only touches the sampled pixels.
+class AverageErrorSampler
+{
+public:
+	AverageErrorSampler(int height, int width);
+	void add(const Image &img);
+	//Compare approximate to the exact average of the num_frames frames added, at the sampled pixels, and print how far off it is.
+	void report(const Image &approximate, int num_frames) const;
+
+	//The grid is at most this many pixels on each side.
+	static const int GRID_SIZE = 64;
+
+private:
+	std::vector<size_t> pixels;
+	std::vector<unsigned long long> totals;
+};
+
+#endif //AVERAGEACCUMULATOR_H
@@ -0,0 +1,197 @@
+// LeastAverageImage
+// Andrew Eckel
+// checkpoint.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#define _FILE_OFFSET_BITS 64
+
+#include "checkpoint.h"
+#include "utility.h"
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+//Every checkpoint file starts with this header. The rest of the file is payload_bytes bytes long.
+static const char CHECKPOINT_MAGIC[8] = { 'L', 'A', 'I', 'C', 'K', 'P', 'T', '1' };
+typedef struct
+{
+	char magic[8];
+	uint64_t settings_hash;
+	int32_t phase, frames_done, height, width;
+	uint64_t payload_bytes;
+} CheckpointHeader;
+
+uint64_t Checkpoint::hashSettings(const std::string &description)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for(size_t c = 0; c < description.size(); ++c){
+		hash ^= (unsigned char) description[c];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+//Open the temporary file for a checkpoint and write its header.
+static FILE *beginCheckpointFile(const std::string &temporary_filename, uint64_t settings_hash, Checkpoint::Phase phase,
+                                 int frames_done, int height, int width, uint64_t payload_bytes)
+{
+	FILE *file = fopen(temporary_filename.c_str(), "wb");
+	if(file == NULL){
+		return NULL;
+	}
+	CheckpointHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.settings_hash = settings_hash;
+	header.phase = phase;
+	header.frames_done = frames_done;
+	header.height = height;
+	header.width = width;
+	header.payload_bytes = payload_bytes;
+	if(fwrite(&header, sizeof(header), 1, file) != 1){
+		fclose(file);
+		return NULL;
+	}
+	return file;
+}
+
+//Close the temporary file and, if everything was written, put it in place of the last checkpoint.
+static bool endCheckpointFile(FILE *file, bool written, const std::string &temporary_filename, const std::string &filename)
+{
+	if(file == NULL){
+		written = false;
+	}
+	else if(fclose(file) != 0){
+		written = false;
+	}
+	if(written && rename(temporary_filename.c_str(), filename.c_str()) != 0){
+		//Windows won't rename over an existing file.
+		remove(filename.c_str());
+		written = rename(temporary_filename.c_str(), filename.c_str()) == 0;
+	}
+	if(!written){
+		remove(temporary_filename.c_str());
+		std::cout << "WARNING: Couldn't write checkpoint file " << filename << std::endl;
+	}
+	return written;
+}
+
+bool Checkpoint::writeAveraging(const std::string &filename, uint64_t settings_hash, int frames_done,
+                                int height, int width, const std::vector<unsigned long long> &totals)
+{
+	const std::string temporary_filename = filename + ".tmp";
+	FILE *file = beginCheckpointFile(temporary_filename, settings_hash, AVERAGING, frames_done, height, width,
+	                                 totals.size() * sizeof(unsigned long long));
+	bool written = file != NULL && fwrite(&totals[0], sizeof(unsigned long long), totals.size(), file) == totals.size();
+	if(written){
+		countBytesWritten(sizeof(CheckpointHeader) + totals.size() * sizeof(unsigned long long));
+	}
+	return endCheckpointFile(file, written, temporary_filename, filename);
+}
+
+bool Checkpoint::writeDifferentiating(const std::string &filename, uint64_t settings_hash, int frames_done,
+                                      const Image &average, const std::vector<DifferenceRecord> &drs)
+{
+	const std::string temporary_filename = filename + ".tmp";
+	const size_t average_pixels = (size_t) average.height * average.width;
+	uint64_t payload_bytes = average_pixels * sizeof(Pixel);
+	for(size_t drs_index = 0; drs_index < drs.size(); ++drs_index){
+		payload_bytes += drs[drs_index].rankings.writtenBytes();
+	}
+	FILE *file = beginCheckpointFile(temporary_filename, settings_hash, DIFFERENTIATING, frames_done,
+	                                 average.height, average.width, payload_bytes);
+	bool written = file != NULL && fwrite(average.data, sizeof(Pixel), average_pixels, file) == average_pixels;
+	for(size_t drs_index = 0; written && drs_index < drs.size(); ++drs_index){
+		written = drs[drs_index].rankings.write(file);
+	}
+	if(written){
+		countBytesWritten(sizeof(CheckpointHeader) + payload_bytes);
+	}
+	return endCheckpointFile(file, written, temporary_filename, filename);
+}
+
+Checkpoint::Checkpoint()
+{
+	file = NULL;
+	saved_phase = AVERAGING;
+	frames_done = 0;
+	height = 0;
+	width = 0;
+}
+
+Checkpoint::~Checkpoint()
+{
+	close();
+}
+
+bool Checkpoint::open(const std::string &filename, uint64_t settings_hash, int height, int width)
+{
+	close();
+	this->filename = filename;
+	struct stat st;
+	if(stat(filename.c_str(), &st) != 0 || (file = fopen(filename.c_str(), "rb")) == NULL){
+		std::cout << "WARNING: No checkpoint found at " << filename << ". Starting from the beginning." << std::endl;
+		return false;
+	}
+	CheckpointHeader header;
+	if(fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0
+		|| (uint64_t) st.st_size != sizeof(header) + header.payload_bytes
+		|| (header.phase != AVERAGING && header.phase != DIFFERENTIATING)){
+		std::cout << "WARNING: Checkpoint file " << filename << " is incomplete or damaged. Starting from the beginning." << std::endl;
+		close();
+		return false;
+	}
+	if(header.settings_hash != settings_hash || header.height != height || header.width != width){
+		std::cout << "WARNING: Checkpoint file " << filename << " was written with different settings. Starting from the beginning." << std::endl;
+		close();
+		return false;
+	}
+	saved_phase = (Phase) header.phase;
+	frames_done = header.frames_done;
+	this->height = height;
+	this->width = width;
+	return true;
+}
+
+void Checkpoint::readTotals(std::vector<unsigned long long> &totals)
+{
+	if(file == NULL || saved_phase != AVERAGING
+		|| fread(&totals[0], sizeof(unsigned long long), totals.size(), file) != totals.size()){
+		std::cerr << "ERROR: Can't read the totals from checkpoint file " << filename << "\n";
+		throw RunError();
+	}
+}
+
+Image Checkpoint::readAverage()
+{
+	Image average = createImageUninitialized(height, width);
+	const size_t pixels = (size_t) height * width;
+	if(file == NULL || saved_phase != DIFFERENTIATING || fread(average.data, sizeof(Pixel), pixels, file) != pixels){
+		std::cerr << "ERROR: Can't read the average from checkpoint file " << filename << "\n";
+		deleteImage(average);
+		throw RunError();
+	}
+	return average;
+}
+
+void Checkpoint::readRankings(std::vector<DifferenceRecord> &drs)
+{
+	for(size_t drs_index = 0; drs_index < drs.size(); ++drs_index){
+		if(file == NULL || saved_phase != DIFFERENTIATING || !drs[drs_index].rankings.read(file)){
+			std::cerr << "ERROR: Can't read the " << drs[drs_index].name << " rankings from checkpoint file " << filename << "\n";
+			throw RunError();
+		}
+	}
+}
+
+void Checkpoint::close()
+{
+	if(file != NULL){
+		fclose(file);
+		file = NULL;
+	}
+}
@@ -0,0 +1,67 @@
+// LeastAverageImage
+// Andrew Eckel
+// checkpoint.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "ppm_functions.h"
+#include "differencerecord.h"
+
+//A checkpoint file lets a long run pick up where it left off after a crash, instead of starting over.
+//It holds everything the run has built up so far in its current phase: the running totals, in the averaging phase,
+//or the average and every difference record's (unfinished) rankings, in the differentiating phase.
+//Along with that go the number of frames of that phase that are done, and a hash of the settings that all of it
+//depends on, so a checkpoint is never resumed with settings that would give different results.
+//Checkpoint files are in the byte order of the machine that wrote them, and are meant to be resumed on the same one.
+class Checkpoint
+{
+public:
+	enum Phase { AVERAGING = 1, DIFFERENTIATING = 2 };
+
+	//A 64 bit FNV-1a hash of a description of the settings.
+	static uint64_t hashSettings(const std::string &description);
+
+	//Write a checkpoint for after the first frames_done frames of the averaging or differentiating phase.
+	//The checkpoint is written to a temporary file and then renamed to filename, so if the program dies in the middle
+	//of writing it, the last checkpoint is still there. Returns false, after printing a warning, if it can't be written.
+	static bool writeAveraging(const std::string &filename, uint64_t settings_hash, int frames_done,
+	                           int height, int width, const std::vector<unsigned long long> &totals);
+	static bool writeDifferentiating(const std::string &filename, uint64_t settings_hash, int frames_done,
+	                                 const Image &average, const std::vector<DifferenceRecord> &drs);
+
+	//Reading a checkpoint: open it, then read the parts for its phase, in order.
+	Checkpoint();
+	~Checkpoint();
+	Checkpoint(const Checkpoint &) = delete;
+	Checkpoint &operator=(const Checkpoint &) = delete;
+
+	//Returns false, after printing a warning, if there is no checkpoint at filename, or it was written with other
+	//settings or for a different image size, or it is incomplete.
+	bool open(const std::string &filename, uint64_t settings_hash, int height, int width);
+	Phase phase() const { return saved_phase; }
+	int framesDone() const { return frames_done; }
+	//AVERAGING: totals must already have height * width * 3 elements.
+	void readTotals(std::vector<unsigned long long> &totals);
+	//DIFFERENTIATING: the average first, then the rankings, into drs that have been allocated as they were when
+	//the checkpoint was written.
+	Image readAverage();
+	void readRankings(std::vector<DifferenceRecord> &drs);
+	void close();
+
+private:
+	FILE *file;
+	std::string filename;
+	Phase saved_phase;
+	int frames_done, height, width;
+};
+
+#endif //CHECKPOINT_H
@@ -6,6 +6,7 @@
 // which is duplicated at the bottom of main.cpp
 
 #include "differencefunctions.h"
+#include "differencekernels.h"
 
 //DifferenceFunctions note:
 //All commented-out code here should be considered legitimate documenation of alternatives and their pros and cons.
@@ -149,4 +150,112 @@ double DifferenceFunctions::difference_Experiment(Pixel p1, Pixel p2){
 	double p2_BtoG = (1.0 * p2.b) / std::max((int) p2.g, 1);
 
 	return sqrt(pow(p1_GtoR - p2_GtoR, 2.0) + 2 * pow(p1_BtoR - p2_BtoR, 2.0) + pow(p1_BtoG - p2_BtoG, 2.0));
-}
\ No newline at end of file
+	//The SSE4.1 and AVX2 versions of this function are ExperimentColorRatio in differencekernels.h.
+	//When trying out a new experiment, either change that one too, or have rowFunction() return the scalar version.
+}
+
+//Score bounds-------------------------------------------------------------------------------------------------------
+
+double DifferenceFunctions::scoreBound(FunctionId id){
+	//Every three-term function is sqrt(x*x + 2*y*y + z*z) with each term at most 255 apart:
+	//channels are 0 to 255, the ratios are 0 to 255, and Half Inverted's ratios are -127 to 128.
+	//So none of them can go over sqrt(4 * 255 * 255) = 510.
+	const double THREE_TERM_BOUND = 510.0;
+	switch(id){
+		case PERCEIVED_BRIGHTNESS:
+			return 255.0;
+		case COMBINED:
+			return THREE_TERM_BOUND / 512.0 + 9.0 * sqrt(THREE_TERM_BOUND) / sqrt(440.0) + 1.0;
+		default:
+			return THREE_TERM_BOUND;
+	}
+}
+
+//Row functions-------------------------------------------------------------------------------------------------------
+
+//The lookup tables are filled in with the same expressions the functions above use, so they hold exactly the
+//same quotients and squares.
+void DifferenceFunctions::fillLookupTables(LookupTables &t){
+	for(int a = 0; a < 256; ++a){
+		for(int b = 0; b < 256; ++b){
+			t.quotient[(a << 8) | b] = (1.0 * a) / std::max(b, 1);
+			t.half_inverted[(a << 8) | b] = (128.0 - a) / std::max(128 - b, 1);
+		}
+		t.brightness_r[a] = 0.299*a*a;
+		t.brightness_g[a] = 0.587*a*a;
+		t.brightness_b[a] = 0.114*a*a;
+	}
+}
+
+const DifferenceFunctions::LookupTables &DifferenceFunctions::lookupTables(){
+	//About a megabyte, so it lives in static storage rather than on the stack.
+	static LookupTables t;
+	static bool filled = (fillLookupTables(t), true);
+	(void) filled;
+	return t;
+}
+
+//Every version of the row functions that this processor supports, worked out once.
+struct DifferenceFunctions::Tables
+{
+	InstructionSet best;
+	bool available[AVX2 + 1];
+	RowFunction rows[AVX2 + 1][NUM_FUNCTIONS];
+	FusedRowFunction fused[AVX2 + 1][NUM_FUNCTION_SETS];
+};
+
+const DifferenceFunctions::Tables &DifferenceFunctions::tables(){
+	static Tables t = makeTables();
+	return t;
+}
+
+DifferenceFunctions::Tables DifferenceFunctions::makeTables(){
+	Tables t;
+	t.available[SCALAR] = true;
+	FILL_DIFFERENCE_ROW_TABLES(t.rows[SCALAR], t.fused[SCALAR], ScalarOps)
+	lookupTables();
+
+	t.available[SSE41] = false;
+	t.available[AVX2] = false;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse4.1")){
+		t.available[SSE41] = rowFunctionsSSE41(t.rows[SSE41], t.fused[SSE41]);
+	}
+	if(__builtin_cpu_supports("avx2")){
+		t.available[AVX2] = rowFunctionsAVX2(t.rows[AVX2], t.fused[AVX2]);
+	}
+#endif
+	t.best = t.available[AVX2] ? AVX2 : (t.available[SSE41] ? SSE41 : SCALAR);
+	return t;
+}
+
+DifferenceFunctions::InstructionSet DifferenceFunctions::bestInstructionSet(){
+	return tables().best;
+}
+
+std::string DifferenceFunctions::instructionSetName(InstructionSet isa){
+	switch(isa){
+		case AVX2: return "AVX2";
+		case SSE41: return "SSE4.1";
+		default: return "scalar";
+	}
+}
+
+DifferenceFunctions::RowFunction DifferenceFunctions::rowFunction(FunctionId id, InstructionSet isa){
+	const Tables &t = tables();
+	return t.available[isa] ? t.rows[isa][id] : NULL;
+}
+
+DifferenceFunctions::RowFunction DifferenceFunctions::rowFunction(FunctionId id){
+	return rowFunction(id, bestInstructionSet());
+}
+
+DifferenceFunctions::FusedRowFunction DifferenceFunctions::fusedRowFunction(unsigned int function_set, InstructionSet isa){
+	const Tables &t = tables();
+	return (t.available[isa] && function_set < NUM_FUNCTION_SETS) ? t.fused[isa][function_set] : NULL;
+}
+
+DifferenceFunctions::FusedRowFunction DifferenceFunctions::fusedRowFunction(unsigned int function_set){
+	return fusedRowFunction(function_set, bestInstructionSet());
+}
@@ -15,8 +15,78 @@
 #include "ppm_functions.h"
 
 class DifferenceFunctions{
+public:
+	//Identifies each difference function, for the row functions below.
+	enum FunctionId {
+		REGULAR,
+		PERCEIVED_BRIGHTNESS,
+		COLOR_RATIO,
+		INVERTED_COLOR_RATIO,
+		HALF_INVERTED_COLOR_RATIO,
+		INVERTED_ENUMERATOR_COLOR_RATIO,
+		COMBINED,
+		EXPERIMENT,
+		NUM_FUNCTIONS
+	};
+	enum InstructionSet { SCALAR, SSE41, AVX2 };
+
+	//A row function scores a whole row at once: scores[j] = difference(avg[j], frame[j]) for j from 0 to n - 1.
+	//The SSE4.1 and AVX2 versions live in differencekernels.h. See the note there about how closely they
+	//match the one-pixel-at-a-time functions.
+	typedef void (*RowFunction)(const Pixel *avg, const Pixel *frame, double *scores, int n);
+
+	//A fused row function scores a whole row with a whole set of difference functions in one pass,
+	//sharing the work they have in common: scores[id][j] = difference_id(avg[j], frame[j]) for every id in the set.
+	//Sets are bit masks, with bit (1 << id) for each FunctionId, and each set has its own compiled function.
+	typedef void (*FusedRowFunction)(const Pixel *avg, const Pixel *frame, double *const *scores, int n);
+	static const unsigned int NUM_FUNCTION_SETS = 1u << NUM_FUNCTIONS;
+
+	//The fastest version of a row function that this processor supports.
+	static RowFunction rowFunction(FunctionId id);
+	//A particular version of a row function, or NULL if this processor (or this build) doesn't support it.
+	static RowFunction rowFunction(FunctionId id, InstructionSet isa);
+	//The fastest (or a particular) version of the fused row function for a set of difference functions.
+	static FusedRowFunction fusedRowFunction(unsigned int function_set);
+	static FusedRowFunction fusedRowFunction(unsigned int function_set, InstructionSet isa);
+	static InstructionSet bestInstructionSet();
+	static std::string instructionSetName(InstructionSet isa);
+
+	//No score from function id is ever bigger than this. (Some of the "possible range" comments in
+	//differencefunctions.cpp are rough; these are worked out from the formulas.)
+	//If you change difference_Experiment, check its bound here too.
+	static double scoreBound(FunctionId id);
+
+	//Every input to the ratio functions and to perceived_Brightness is an 8 bit channel, so the row functions
+	//look their divisions and squares up instead of computing them. Each entry is computed exactly the way the
+	//one-pixel-at-a-time functions compute it, so looking it up gives the very same double.
+	//The two-channel tables are indexed by (a << 8) | b.
+	struct LookupTables
+	{
+		//quotient[(a << 8) | b] = a / max(b, 1).
+		//All of the ratio variants except Half Inverted are this table with remapped indices:
+		//Inverted uses (255 - a, 255 - b), Inverted Enumerator uses (255 - a, b), and Flipped swaps a and b.
+		double quotient[256 * 256];
+		//half_inverted[(a << 8) | b] = (128 - a) / max(128 - b, 1).
+		double half_inverted[256 * 256];
+		//The squared, weighted channels that perceived_Brightness adds up: brightness_r[x] = 0.299*x*x, and so on.
+		double brightness_r[256];
+		double brightness_g[256];
+		double brightness_b[256];
+	};
+	//Built the first time it is needed, which is when the row functions are first looked up.
+	static const LookupTables &lookupTables();
+
 private:
 	static double perceived_Brightness(Pixel color);
+	//Defined in differencefunctions_avx2.cpp and differencefunctions_sse41.cpp. Each fills in a table of row functions
+	//indexed by FunctionId and a table of fused row functions indexed by set, and returns true,
+	//or returns false if that file was compiled without the instruction set.
+	static bool rowFunctionsAVX2(RowFunction *rows, FusedRowFunction *fused);
+	static bool rowFunctionsSSE41(RowFunction *rows, FusedRowFunction *fused);
+	struct Tables;
+	static const Tables &tables();
+	static Tables makeTables();
+	static void fillLookupTables(LookupTables &t);
 public:
 	//All functions are static.
 	static double difference_Regular(Pixel p1, Pixel p2);
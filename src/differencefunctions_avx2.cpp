@@ -0,0 +1,70 @@
+// LeastAverageImage
+// Andrew Eckel
+// differencefunctions_avx2.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+// The AVX2 versions of the row functions. This file is compiled with -mavx2 (see the Makefile),
+// and its functions are only ever called after checking that the processor supports AVX2.
+// Compiled without AVX2 support, it provides no functions, and the program falls back to something slower.
+
+#include "differencefunctions.h"
+
+#ifdef __AVX2__
+
+#include <immintrin.h>
+#include <string.h>
+
+#include "differencekernels.h"
+
+namespace {
+
+struct AVX2Ops
+{
+	typedef __m256d vec;
+	typedef __m128i ivec;
+	static const int WIDTH = KERNEL_WIDTH;
+
+	//Four pixels are exactly 12 bytes. Read exactly those (never past the end of the row),
+	//and spread each channel out into four 32 bit integers.
+	static inline void load(const Pixel *p, ivec &r, ivec &g, ivec &b)
+	{
+		const unsigned char *bytes = (const unsigned char *) p;
+		int last_four;
+		memcpy(&last_four, bytes + 8, 4);
+		__m128i all = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) bytes), _mm_cvtsi32_si128(last_four));
+		r = _mm_shuffle_epi8(all, _mm_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1));
+		g = _mm_shuffle_epi8(all, _mm_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1));
+		b = _mm_shuffle_epi8(all, _mm_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1));
+	}
+	static inline vec toDouble(ivec a) { return _mm256_cvtepi32_pd(a); }
+	static inline ivec pairIndex(ivec a, ivec b) { return _mm_or_si128(_mm_slli_epi32(a, 8), b); }
+	static inline ivec invert(ivec a) { return _mm_xor_si128(a, _mm_set1_epi32(255)); }
+	static inline vec lookup(const double *table, ivec i) { return _mm256_i32gather_pd(table, i, 8); }
+	static inline vec set1(double x) { return _mm256_set1_pd(x); }
+	static inline vec add(vec a, vec b) { return _mm256_add_pd(a, b); }
+	static inline vec sub(vec a, vec b) { return _mm256_sub_pd(a, b); }
+	static inline vec mul(vec a, vec b) { return _mm256_mul_pd(a, b); }
+	static inline vec div(vec a, vec b) { return _mm256_div_pd(a, b); }
+	static inline vec sqrt(vec a) { return _mm256_sqrt_pd(a); }
+	static inline vec abs(vec a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+	static inline void store(double *out, vec v) { _mm256_storeu_pd(out, v); }
+};
+
+} //namespace
+
+bool DifferenceFunctions::rowFunctionsAVX2(RowFunction *rows, FusedRowFunction *fused)
+{
+	FILL_DIFFERENCE_ROW_TABLES(rows, fused, AVX2Ops)
+	return true;
+}
+
+#else
+
+bool DifferenceFunctions::rowFunctionsAVX2(RowFunction * /*rows*/, FusedRowFunction * /*fused*/)
+{
+	return false;
+}
+
+#endif //__AVX2__
@@ -0,0 +1,95 @@
+// LeastAverageImage
+// Andrew Eckel
+// differencefunctions_sse41.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+// The SSE4.1 versions of the row functions, for processors without AVX2. This file is compiled with -msse4.1
+// (see the Makefile), and its functions are only ever called after checking that the processor supports SSE4.1.
+// Compiled without SSE4.1 support, it provides no functions, and the program falls back to plain C++.
+
+#include "differencefunctions.h"
+
+#ifdef __SSE4_1__
+
+#include <smmintrin.h>
+#include <string.h>
+
+#include "differencekernels.h"
+
+namespace {
+
+//SSE registers only hold two doubles, so each step works on a pair of them.
+typedef struct
+{
+	__m128d lo, hi;
+} SSE41Pair;
+
+struct SSE41Ops
+{
+	typedef SSE41Pair vec;
+	typedef __m128i ivec;
+	static const int WIDTH = KERNEL_WIDTH;
+
+	//Read exactly the 12 bytes of four pixels and spread each channel out into four 32 bit integers.
+	static inline void load(const Pixel *p, ivec &r, ivec &g, ivec &b)
+	{
+		const unsigned char *bytes = (const unsigned char *) p;
+		int last_four;
+		memcpy(&last_four, bytes + 8, 4);
+		__m128i all = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) bytes), _mm_cvtsi32_si128(last_four));
+		r = _mm_shuffle_epi8(all, _mm_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1));
+		g = _mm_shuffle_epi8(all, _mm_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1));
+		b = _mm_shuffle_epi8(all, _mm_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1));
+	}
+	static inline vec toDouble(ivec ints)
+	{
+		vec v;
+		v.lo = _mm_cvtepi32_pd(ints);
+		v.hi = _mm_cvtepi32_pd(_mm_unpackhi_epi64(ints, ints));
+		return v;
+	}
+	static inline ivec pairIndex(ivec a, ivec b) { return _mm_or_si128(_mm_slli_epi32(a, 8), b); }
+	static inline ivec invert(ivec a) { return _mm_xor_si128(a, _mm_set1_epi32(255)); }
+	//SSE has no gather, so the four lookups are done one at a time.
+	static inline vec lookup(const double *table, ivec i)
+	{
+		vec v;
+		v.lo = _mm_loadh_pd(_mm_load_sd(table + _mm_cvtsi128_si32(i)), table + _mm_extract_epi32(i, 1));
+		v.hi = _mm_loadh_pd(_mm_load_sd(table + _mm_extract_epi32(i, 2)), table + _mm_extract_epi32(i, 3));
+		return v;
+	}
+	static inline vec set1(double x) { vec v; v.lo = v.hi = _mm_set1_pd(x); return v; }
+	static inline vec add(vec a, vec b) { vec v; v.lo = _mm_add_pd(a.lo, b.lo); v.hi = _mm_add_pd(a.hi, b.hi); return v; }
+	static inline vec sub(vec a, vec b) { vec v; v.lo = _mm_sub_pd(a.lo, b.lo); v.hi = _mm_sub_pd(a.hi, b.hi); return v; }
+	static inline vec mul(vec a, vec b) { vec v; v.lo = _mm_mul_pd(a.lo, b.lo); v.hi = _mm_mul_pd(a.hi, b.hi); return v; }
+	static inline vec div(vec a, vec b) { vec v; v.lo = _mm_div_pd(a.lo, b.lo); v.hi = _mm_div_pd(a.hi, b.hi); return v; }
+	static inline vec sqrt(vec a) { vec v; v.lo = _mm_sqrt_pd(a.lo); v.hi = _mm_sqrt_pd(a.hi); return v; }
+	static inline vec abs(vec a)
+	{
+		__m128d sign = _mm_set1_pd(-0.0);
+		vec v;
+		v.lo = _mm_andnot_pd(sign, a.lo);
+		v.hi = _mm_andnot_pd(sign, a.hi);
+		return v;
+	}
+	static inline void store(double *out, vec v) { _mm_storeu_pd(out, v.lo); _mm_storeu_pd(out + 2, v.hi); }
+};
+
+} //namespace
+
+bool DifferenceFunctions::rowFunctionsSSE41(RowFunction *rows, FusedRowFunction *fused)
+{
+	FILL_DIFFERENCE_ROW_TABLES(rows, fused, SSE41Ops)
+	return true;
+}
+
+#else
+
+bool DifferenceFunctions::rowFunctionsSSE41(RowFunction * /*rows*/, FusedRowFunction * /*fused*/)
+{
+	return false;
+}
+
+#endif //__SSE4_1__
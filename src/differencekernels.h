@@ -0,0 +1,256 @@
+// LeastAverageImage
+// Andrew Eckel
+// differencekernels.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+// Row-at-a-time versions of the difference functions, written once as templates over a set of vector operations.
+// This header is included by the per-instruction-set translation units (differencefunctions_avx2.cpp,
+// differencefunctions_sse41.cpp), each of which is compiled with its own instruction set flags,
+// and by differencefunctions.cpp for the plain C++ versions.
+// Everything here is in an anonymous namespace on purpose: that way the AVX2 copy of a helper can never be
+// merged with (and end up replacing) the copy compiled for older processors.
+
+// Accuracy:
+// Every kernel does the same double precision operations, in the same order, as its function in
+// differencefunctions.cpp, except that squares are computed as x*x rather than with pow(x, 2.0), and that the
+// channel ratios and weighted squares come out of DifferenceFunctions::lookupTables() (which hold exactly
+// the values the functions compute).
+// x*x is exact to the last bit; depending on the C library, pow may not be. So the kernels agree with the
+// scalar functions to within 1 ULP per squared term (a relative difference below 1e-15 in the score),
+// and are bit-for-bit identical wherever pow(x, 2.0) is computed exactly (as it is when the compiler optimizes it).
+
+#ifndef DIFFERENCEKERNELS_H
+#define DIFFERENCEKERNELS_H
+
+#include <math.h>
+
+#include "ppm_functions.h"
+#include "differencefunctions.h"
+
+namespace {
+
+//Every vector type V used with these kernels processes KERNEL_WIDTH pixels per step, and provides:
+//  V::vec                         a KERNEL_WIDTH-wide vector of doubles
+//  V::ivec                        a KERNEL_WIDTH-wide vector of ints
+//  V::load(p, r, g, b)            the channels of pixels p[0..KERNEL_WIDTH-1], as ints
+//  V::toDouble(i)                 ints converted to doubles
+//  V::pairIndex(a, b)             (a << 8) | b, the index into a two-channel lookup table
+//  V::invert(a)                   255 - a
+//  V::lookup(table, i)            table[i] for each lane
+//  V::set1(x)                     every lane set to x
+//  V::add, sub, mul, div          lane by lane arithmetic
+//  V::sqrt, abs                   lane by lane square root and absolute value
+//  V::store(out, v)               write the lanes to out[0..KERNEL_WIDTH-1]
+const int KERNEL_WIDTH = 4;
+
+//The plain C++ version, one pixel at a time. It is used for the leftover pixels at the end of a row.
+struct ScalarOps
+{
+	typedef double vec;
+	typedef int ivec;
+	static const int WIDTH = 1;
+	static inline void load(const Pixel *p, ivec &r, ivec &g, ivec &b) { r = p->r; g = p->g; b = p->b; }
+	static inline vec toDouble(ivec a) { return a; }
+	static inline ivec pairIndex(ivec a, ivec b) { return (a << 8) | b; }
+	static inline ivec invert(ivec a) { return a ^ 255; }
+	static inline vec lookup(const double *table, ivec i) { return table[i]; }
+	static inline vec set1(double x) { return x; }
+	static inline vec add(vec a, vec b) { return a + b; }
+	static inline vec sub(vec a, vec b) { return a - b; }
+	static inline vec mul(vec a, vec b) { return a * b; }
+	static inline vec div(vec a, vec b) { return a / b; }
+	static inline vec sqrt(vec a) { return ::sqrt(a); }
+	static inline vec abs(vec a) { return ::fabs(a); }
+	static inline void store(double *out, vec v) { *out = v; }
+};
+
+//sqrt((x*x + 2*(y*y)) + z*z): the way most of the difference functions combine their three terms.
+template<class V>
+inline typename V::vec combineTerms(typename V::vec x, typename V::vec y, typename V::vec z)
+{
+	typename V::vec sum = V::add(V::add(V::mul(x, x), V::mul(V::set1(2.0), V::mul(y, y))), V::mul(z, z));
+	return V::sqrt(sum);
+}
+
+template<class V>
+inline typename V::vec perceivedBrightness(const DifferenceFunctions::LookupTables &lut,
+                                           typename V::ivec r, typename V::ivec g, typename V::ivec b)
+{
+	typename V::vec sum = V::add(V::add(V::lookup(lut.brightness_r, r), V::lookup(lut.brightness_g, g)),
+	                             V::lookup(lut.brightness_b, b));
+	return V::sqrt(sum);
+}
+
+//One ratio of the first pixel minus the same ratio of the second, both looked up in table
+//(which decides what a1 "/" b1 means).
+template<class V>
+inline typename V::vec ratioDifference(const double *table, typename V::ivec a1, typename V::ivec b1,
+                                       typename V::ivec a2, typename V::ivec b2)
+{
+	return V::sub(V::lookup(table, V::pairIndex(a1, b1)), V::lookup(table, V::pairIndex(a2, b2)));
+}
+
+//The usual ratio function: compare a/b, a/c, and b/c between the two pixels, and combine the differences.
+template<class V>
+inline typename V::vec ratioTerms(const double *table, typename V::ivec a1, typename V::ivec b1, typename V::ivec c1,
+                                  typename V::ivec a2, typename V::ivec b2, typename V::ivec c2)
+{
+	return combineTerms<V>(ratioDifference<V>(table, a1, b1, a2, b2),
+	                       ratioDifference<V>(table, a1, c1, a2, c2),
+	                       ratioDifference<V>(table, b1, c1, b2, c2));
+}
+
+constexpr unsigned int functionBit(DifferenceFunctions::FunctionId id)
+{
+	return 1u << id;
+}
+
+//Score a block of pixels with every difference function in MASK (a set of bits, one per FunctionId) in one go,
+//writing each function's scores to scores[id][j]. Functions that aren't in MASK are never touched.
+//The work they have in common is only done once: the pixels are loaded once, the Combined function reuses
+//the Regular, ColorRatio, and PerceivedBrightness scores, and the inverted ratio functions share their 255 - x channels.
+//Since MASK is a template parameter, every "if" below is decided at compile time.
+template<class V, unsigned int MASK>
+inline void fusedStep(const DifferenceFunctions::LookupTables &lut, const Pixel *p1, const Pixel *p2,
+                      double *const *scores, int j)
+{
+	typedef typename V::vec vec;
+	typedef typename V::ivec ivec;
+	const bool DO_REGULAR = (MASK & functionBit(DifferenceFunctions::REGULAR)) != 0;
+	const bool DO_PERCEIVED_BRIGHTNESS = (MASK & functionBit(DifferenceFunctions::PERCEIVED_BRIGHTNESS)) != 0;
+	const bool DO_COLOR_RATIO = (MASK & functionBit(DifferenceFunctions::COLOR_RATIO)) != 0;
+	const bool DO_INVERTED_COLOR_RATIO = (MASK & functionBit(DifferenceFunctions::INVERTED_COLOR_RATIO)) != 0;
+	const bool DO_HALF_INVERTED_COLOR_RATIO = (MASK & functionBit(DifferenceFunctions::HALF_INVERTED_COLOR_RATIO)) != 0;
+	const bool DO_INVERTED_ENUMERATOR_COLOR_RATIO = (MASK & functionBit(DifferenceFunctions::INVERTED_ENUMERATOR_COLOR_RATIO)) != 0;
+	const bool DO_COMBINED = (MASK & functionBit(DifferenceFunctions::COMBINED)) != 0;
+	const bool DO_EXPERIMENT = (MASK & functionBit(DifferenceFunctions::EXPERIMENT)) != 0;
+
+	const bool NEED_REGULAR = DO_REGULAR || DO_COMBINED;
+	const bool NEED_PERCEIVED_BRIGHTNESS = DO_PERCEIVED_BRIGHTNESS || DO_COMBINED;
+	const bool NEED_COLOR_RATIO = DO_COLOR_RATIO || DO_COMBINED;
+	const bool NEED_INVERTED = DO_INVERTED_COLOR_RATIO || DO_INVERTED_ENUMERATOR_COLOR_RATIO;
+
+	ivec r1, g1, b1, r2, g2, b2;
+	V::load(p1, r1, g1, b1);
+	V::load(p2, r2, g2, b2);
+	const vec zero = V::set1(0.0);
+
+	ivec inv_r1 = r1, inv_r2 = r2, inv_g1 = g1, inv_g2 = g2;
+	if(NEED_INVERTED){
+		inv_r1 = V::invert(r1);
+		inv_r2 = V::invert(r2);
+		inv_g1 = V::invert(g1);
+		inv_g2 = V::invert(g2);
+	}
+
+	vec regular = zero, perceived_brightness = zero, color_ratio = zero;
+	if(NEED_REGULAR){
+		regular = combineTerms<V>(V::sub(V::toDouble(r1), V::toDouble(r2)),
+		                          V::sub(V::toDouble(g1), V::toDouble(g2)),
+		                          V::sub(V::toDouble(b1), V::toDouble(b2)));
+		if(DO_REGULAR){
+			V::store(scores[DifferenceFunctions::REGULAR] + j, regular);
+		}
+	}
+	if(NEED_PERCEIVED_BRIGHTNESS){
+		perceived_brightness = V::abs(V::sub(perceivedBrightness<V>(lut, r1, g1, b1), perceivedBrightness<V>(lut, r2, g2, b2)));
+		if(DO_PERCEIVED_BRIGHTNESS){
+			V::store(scores[DifferenceFunctions::PERCEIVED_BRIGHTNESS] + j, perceived_brightness);
+		}
+	}
+	if(NEED_COLOR_RATIO){
+		color_ratio = ratioTerms<V>(lut.quotient, r1, g1, b1, r2, g2, b2);
+		if(DO_COLOR_RATIO){
+			V::store(scores[DifferenceFunctions::COLOR_RATIO] + j, color_ratio);
+		}
+	}
+	if(DO_INVERTED_COLOR_RATIO){
+		V::store(scores[DifferenceFunctions::INVERTED_COLOR_RATIO] + j,
+		         ratioTerms<V>(lut.quotient, inv_r1, inv_g1, V::invert(b1), inv_r2, inv_g2, V::invert(b2)));
+	}
+	if(DO_HALF_INVERTED_COLOR_RATIO){
+		V::store(scores[DifferenceFunctions::HALF_INVERTED_COLOR_RATIO] + j,
+		         ratioTerms<V>(lut.half_inverted, r1, g1, b1, r2, g2, b2));
+	}
+	if(DO_INVERTED_ENUMERATOR_COLOR_RATIO){
+		//(255 - r)/g, (255 - r)/b, (255 - g)/b: only the numerators are inverted.
+		V::store(scores[DifferenceFunctions::INVERTED_ENUMERATOR_COLOR_RATIO] + j,
+		         combineTerms<V>(ratioDifference<V>(lut.quotient, inv_r1, g1, inv_r2, g2),
+		                         ratioDifference<V>(lut.quotient, inv_r1, b1, inv_r2, b2),
+		                         ratioDifference<V>(lut.quotient, inv_g1, b1, inv_g2, b2)));
+	}
+	if(DO_COMBINED){
+		V::store(scores[DifferenceFunctions::COMBINED] + j,
+		         V::add(V::add(V::div(regular, V::set1(512.0)),
+		                       V::div(V::mul(V::set1(9.0), V::sqrt(color_ratio)), V::set1(::sqrt(440.0)))),
+		                V::div(perceived_brightness, V::set1(255.0))));
+	}
+	if(DO_EXPERIMENT){
+		//The current experiment: Color Ratio Flipped.
+		//If you change difference_Experiment in differencefunctions.cpp, change this to match.
+		//g/r, b/r, b/g: the Color Ratio lookups with their channels swapped.
+		V::store(scores[DifferenceFunctions::EXPERIMENT] + j,
+		         combineTerms<V>(ratioDifference<V>(lut.quotient, g1, r1, g2, r2),
+		                         ratioDifference<V>(lut.quotient, b1, r1, b2, r2),
+		                         ratioDifference<V>(lut.quotient, b1, g1, b2, g2)));
+	}
+}
+
+//Score a whole row with every function in MASK: avg[j] against frame[j], for j from 0 to n - 1.
+template<class V, unsigned int MASK>
+void fusedRow(const Pixel *avg, const Pixel *frame, double *const *scores, int n)
+{
+	const DifferenceFunctions::LookupTables &lut = DifferenceFunctions::lookupTables();
+	int j = 0;
+	for(; j + V::WIDTH <= n; j += V::WIDTH){
+		fusedStep<V, MASK>(lut, avg + j, frame + j, scores, j);
+	}
+	for(; j < n; ++j){
+		fusedStep<ScalarOps, MASK>(lut, avg + j, frame + j, scores, j);
+	}
+}
+
+//A single function is just the fused row with only that function in it.
+template<class V, DifferenceFunctions::FunctionId ID>
+void singleRow(const Pixel *avg, const Pixel *frame, double *scores, int n)
+{
+	double *table[DifferenceFunctions::NUM_FUNCTIONS];
+	table[ID] = scores;
+	fusedRow<V, (1u << ID)>(avg, frame, table, n);
+}
+
+//Fills table[mask] with fusedRow<V, mask> for every mask from 0 up to MASK.
+template<class V, int MASK>
+struct FusedTableFiller
+{
+	static void fill(DifferenceFunctions::FusedRowFunction *table)
+	{
+		table[MASK] = fusedRow<V, (unsigned int) MASK>;
+		FusedTableFiller<V, MASK - 1>::fill(table);
+	}
+};
+
+template<class V>
+struct FusedTableFiller<V, -1>
+{
+	static void fill(DifferenceFunctions::FusedRowFunction * /*table*/) { }
+};
+
+} //namespace
+
+//Fill in the tables of row functions (indexed by FunctionId) and fused row functions (indexed by mask),
+//for the vector type V.
+#define FILL_DIFFERENCE_ROW_TABLES(rows, fused, V) \
+	rows[DifferenceFunctions::REGULAR] = singleRow<V, DifferenceFunctions::REGULAR>; \
+	rows[DifferenceFunctions::PERCEIVED_BRIGHTNESS] = singleRow<V, DifferenceFunctions::PERCEIVED_BRIGHTNESS>; \
+	rows[DifferenceFunctions::COLOR_RATIO] = singleRow<V, DifferenceFunctions::COLOR_RATIO>; \
+	rows[DifferenceFunctions::INVERTED_COLOR_RATIO] = singleRow<V, DifferenceFunctions::INVERTED_COLOR_RATIO>; \
+	rows[DifferenceFunctions::HALF_INVERTED_COLOR_RATIO] = singleRow<V, DifferenceFunctions::HALF_INVERTED_COLOR_RATIO>; \
+	rows[DifferenceFunctions::INVERTED_ENUMERATOR_COLOR_RATIO] = singleRow<V, DifferenceFunctions::INVERTED_ENUMERATOR_COLOR_RATIO>; \
+	rows[DifferenceFunctions::COMBINED] = singleRow<V, DifferenceFunctions::COMBINED>; \
+	rows[DifferenceFunctions::EXPERIMENT] = singleRow<V, DifferenceFunctions::EXPERIMENT>; \
+	FusedTableFiller<V, DifferenceFunctions::NUM_FUNCTION_SETS - 1>::fill(fused);
+
+#endif //DIFFERENCEKERNELS_H
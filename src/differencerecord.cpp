@@ -0,0 +1,425 @@
+// LeastAverageImage
+// Andrew Eckel
+// differencerecord.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#include "differencerecord.h"
+#include "utility.h"
+
+#include <iostream>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+//Score storage types--------------------------------------------------------------------------------------------------
+
+//Each way of storing scores says what a stored score is, and how to convert a score to (encode) and from (decode) it.
+//encode never puts two scores in the opposite order, so stored scores can be compared directly.
+//scale is only used by QuantizedScores.
+struct DoubleScores
+{
+	typedef double stored;
+	static inline stored encode(double score, double /*scale*/) { return score; }
+	static inline double decode(stored s, double /*scale*/) { return s; }
+};
+
+struct FloatScores
+{
+	typedef float stored;
+	static inline stored encode(double score, double /*scale*/) { return (float) score; }
+	static inline double decode(stored s, double /*scale*/) { return s; }
+};
+
+//A score is scaled by 1 / (the function's largest possible score), to somewhere from 0 to 1, and stored as the
+//exponent and top ten mantissa bits of that as a float, which only leaves room for 64 exponents: 2^-63 up to 1.
+//So every score keeps about three significant digits, like a half-precision float, whether it's near the top of its
+//function's range or far below it, as most color ratio scores are. Anything smaller than that is stored as zero.
+struct QuantizedScores
+{
+	typedef unsigned short stored;
+	enum { MANTISSA_SHIFT = 13, SMALLEST_EXPONENT = 127 - 63 };
+	static inline stored encode(double score, double scale)
+	{
+		float x = (float) (score * scale);
+		if(!(x >= 1.0f / 9223372036854775808.0f)){ //2^-63; also catches NaN
+			return 0;
+		}
+		if(x > 1.0f){
+			x = 1.0f;
+		}
+		uint32_t bits;
+		memcpy(&bits, &x, sizeof(bits));
+		return (stored) ((bits >> MANTISSA_SHIFT) - (SMALLEST_EXPONENT << (23 - MANTISSA_SHIFT)) + 1);
+	}
+	static inline double decode(stored s, double scale)
+	{
+		if(s == 0){
+			return 0.0;
+		}
+		//Fill in the middle of the range of floats that encode to s.
+		uint32_t bits = ((uint32_t) (s - 1 + (SMALLEST_EXPONENT << (23 - MANTISSA_SHIFT))) << MANTISSA_SHIFT)
+			| (1u << (MANTISSA_SHIFT - 1));
+		float x;
+		memcpy(&x, &bits, sizeof(x));
+		return x / scale;
+	}
+};
+
+//RankingBuffer--------------------------------------------------------------------------------------------------------
+
+RankingBuffer::RankingBuffer()
+{
+	height = 0;
+	width = 0;
+	num_rankings = 0;
+	chosen_strategy = SORTED_INSERT;
+	score_precision = DOUBLE_SCORES;
+	quantization_scale = 1.0;
+	scores = NULL;
+	colors = NULL;
+	arrivals = NULL;
+}
+
+RankingBuffer::~RankingBuffer()
+{
+	release();
+}
+
+RankingBuffer::RankingBuffer(RankingBuffer &&other) noexcept
+{
+	height = other.height;
+	width = other.width;
+	num_rankings = other.num_rankings;
+	chosen_strategy = other.chosen_strategy;
+	score_precision = other.score_precision;
+	quantization_scale = other.quantization_scale;
+	scores = other.scores;
+	colors = other.colors;
+	arrivals = other.arrivals;
+	other.scores = NULL;
+	other.colors = NULL;
+	other.arrivals = NULL;
+	other.num_rankings = 0;
+}
+
+RankingBuffer &RankingBuffer::operator=(RankingBuffer &&other) noexcept
+{
+	if(this != &other){
+		release();
+		height = other.height;
+		width = other.width;
+		num_rankings = other.num_rankings;
+		chosen_strategy = other.chosen_strategy;
+		score_precision = other.score_precision;
+		quantization_scale = other.quantization_scale;
+		scores = other.scores;
+		colors = other.colors;
+		arrivals = other.arrivals;
+		other.scores = NULL;
+		other.colors = NULL;
+		other.arrivals = NULL;
+		other.num_rankings = 0;
+	}
+	return *this;
+}
+
+size_t RankingBuffer::scoreBytes(Precision precision)
+{
+	switch(precision){
+		case FLOAT_SCORES: return sizeof(FloatScores::stored);
+		case QUANTIZED_SCORES: return sizeof(QuantizedScores::stored);
+		default: return sizeof(DoubleScores::stored);
+	}
+}
+
+void RankingBuffer::allocate(int height, int width, int num_rankings, Precision precision, double score_bound,
+                             Strategy strategy)
+{
+	release();
+	this->height = height;
+	this->width = width;
+	this->num_rankings = num_rankings;
+	if(strategy == AUTOMATIC){
+		strategy = (num_rankings <= MAX_SORTED_INSERT_RANKINGS) ? SORTED_INSERT : HEAP;
+	}
+	chosen_strategy = strategy;
+	score_precision = precision;
+	quantization_scale = (score_bound > 0.0) ? 1.0 / score_bound : 1.0;
+
+	size_t entries = (size_t) height * width * num_rankings;
+	scores = alignedMalloc(entries * scoreBytes(precision));
+	colors = (Pixel *) alignedMalloc(entries * sizeof(Pixel));
+	if(chosen_strategy == HEAP){
+		arrivals = (unsigned int *) alignedMalloc(entries * sizeof(unsigned int));
+	}
+	if(scores == NULL || colors == NULL || (chosen_strategy == HEAP && arrivals == NULL)){
+		std::cerr << "ERROR: Not enough memory to rank " << num_rankings << " colors for each pixel of a "
+			<< height << " by " << width << " image.\n";
+		throw RunError();
+	}
+	//All bits zero is a score of 0 for every precision, and all bits set is white for Pixels.
+	//Since every starting entry is the same, they are in order, and they also make a valid heap.
+	memset(scores, 0, entries * scoreBytes(precision));
+	memset(colors, 255, entries * sizeof(Pixel));
+	if(arrivals != NULL){
+		memset(arrivals, 0, entries * sizeof(unsigned int));
+	}
+}
+
+void RankingBuffer::release()
+{
+	alignedFree(scores);
+	alignedFree(colors);
+	alignedFree(arrivals);
+	scores = NULL;
+	colors = NULL;
+	arrivals = NULL;
+	num_rankings = 0;
+}
+
+//Saving and loading---------------------------------------------------------------------------------------------------
+
+//write starts with these, so read can tell whether the saved rankings fit.
+static const int RANKING_LAYOUT_FIELDS = 5;
+
+size_t RankingBuffer::writtenBytes() const
+{
+	size_t entries = (size_t) height * width * num_rankings;
+	size_t bytes = RANKING_LAYOUT_FIELDS * sizeof(int32_t) + entries * (scoreBytes(score_precision) + sizeof(Pixel));
+	if(chosen_strategy == HEAP){
+		bytes += entries * sizeof(unsigned int);
+	}
+	return bytes;
+}
+
+bool RankingBuffer::write(FILE *file) const
+{
+	int32_t layout[RANKING_LAYOUT_FIELDS] = { height, width, num_rankings, chosen_strategy, score_precision };
+	size_t entries = (size_t) height * width * num_rankings;
+	if(fwrite(layout, sizeof(int32_t), RANKING_LAYOUT_FIELDS, file) != RANKING_LAYOUT_FIELDS
+		|| fwrite(scores, scoreBytes(score_precision), entries, file) != entries
+		|| fwrite(colors, sizeof(Pixel), entries, file) != entries){
+		return false;
+	}
+	return chosen_strategy != HEAP || fwrite(arrivals, sizeof(unsigned int), entries, file) == entries;
+}
+
+bool RankingBuffer::read(FILE *file)
+{
+	int32_t layout[RANKING_LAYOUT_FIELDS];
+	if(fread(layout, sizeof(int32_t), RANKING_LAYOUT_FIELDS, file) != RANKING_LAYOUT_FIELDS
+		|| layout[0] != height || layout[1] != width || layout[2] != num_rankings
+		|| layout[3] != chosen_strategy || layout[4] != score_precision){
+		return false;
+	}
+	size_t entries = (size_t) height * width * num_rankings;
+	if(fread(scores, scoreBytes(score_precision), entries, file) != entries
+		|| fread(colors, sizeof(Pixel), entries, file) != entries){
+		return false;
+	}
+	return chosen_strategy != HEAP || fread(arrivals, sizeof(unsigned int), entries, file) == entries;
+}
+
+//Sorted insert--------------------------------------------------------------------------------------------------------
+
+//s and c are one pixel's rankings, in order. If diff beats the lowest ranked score, it is inserted in order
+//and everything below it moves down one rank.
+template<class T>
+static inline void sortedInsert(T *s, Pixel *c, int num_rankings, T diff, const Pixel &color)
+{
+	int rank = num_rankings - 1;
+	if(!(diff > s[rank])){
+		return;
+	}
+	while(rank > 0 && diff > s[rank - 1]){
+		--rank;
+	}
+	for(int k = num_rankings - 1; k > rank; --k){
+		s[k] = s[k - 1];
+		c[k] = c[k - 1];
+	}
+	s[rank] = diff;
+	c[rank] = color;
+}
+
+//With K known at compile time, sortedInsert's loops are unrolled. K == 0 means num_rankings isn't known until run time.
+template<int K, class Codec>
+static void offerRowSorted(typename Codec::stored *s, Pixel *c, int num_rankings, double scale,
+                           const double *diffs, const Pixel *candidates, int n)
+{
+	if(K != 0){
+		num_rankings = K;
+	}
+	for(int j = 0; j < n; ++j, s += num_rankings, c += num_rankings){
+		sortedInsert(s, c, num_rankings, Codec::encode(diffs[j], scale), candidates[j]);
+	}
+}
+
+//Heap-----------------------------------------------------------------------------------------------------------------
+
+//True if entry a ranks below entry b: a smaller score, or the same score but a later arrival.
+//This is exactly the order the sorted insert keeps, so both strategies rank (and evict) the same entries.
+template<class T>
+static inline bool ranksBelow(T score_a, unsigned int arrival_a, T score_b, unsigned int arrival_b)
+{
+	return score_a < score_b || (score_a == score_b && arrival_a > arrival_b);
+}
+
+//Put an entry into the heap (s, c, a) of size entries at position hole, moving it down past any
+//children that rank below it. The heap has the lowest ranked entry on top.
+template<class T>
+static inline void siftDown(T *s, Pixel *c, unsigned int *a, int size, int hole,
+                            T score, const Pixel &color, unsigned int arrival)
+{
+	while(true){
+		int child = 2 * hole + 1;
+		if(child >= size){
+			break;
+		}
+		if(child + 1 < size && ranksBelow(s[child + 1], a[child + 1], s[child], a[child])){
+			++child;
+		}
+		if(!ranksBelow(s[child], a[child], score, arrival)){
+			break;
+		}
+		s[hole] = s[child];
+		c[hole] = c[child];
+		a[hole] = a[child];
+		hole = child;
+	}
+	s[hole] = score;
+	c[hole] = color;
+	a[hole] = arrival;
+}
+
+template<class Codec>
+static void offerRowHeap(typename Codec::stored *s, Pixel *c, unsigned int *a, int num_rankings, double scale,
+                         const double *diffs, const Pixel *candidates, int n, unsigned int arrival)
+{
+	for(int j = 0; j < n; ++j, s += num_rankings, c += num_rankings, a += num_rankings){
+		//The top of the heap is the lowest ranked entry, and a candidate has to beat it to get in.
+		typename Codec::stored diff = Codec::encode(diffs[j], scale);
+		if(diff > s[0]){
+			siftDown(s, c, a, num_rankings, 0, diff, candidates[j], arrival);
+		}
+	}
+}
+
+//Dispatch-------------------------------------------------------------------------------------------------------------
+
+template<class Codec>
+void RankingBuffer::offerRowAs(size_t first_pixel, const double *diffs, const Pixel *candidates, int n,
+                               unsigned int arrival)
+{
+	typename Codec::stored *s = (typename Codec::stored *) scores + first_pixel * num_rankings;
+	Pixel *c = colors + first_pixel * num_rankings;
+	if(chosen_strategy == HEAP){
+		offerRowHeap<Codec>(s, c, arrivals + first_pixel * num_rankings, num_rankings, quantization_scale,
+		                    diffs, candidates, n, arrival);
+		return;
+	}
+	switch(num_rankings){
+		case 1: offerRowSorted<1, Codec>(s, c, num_rankings, quantization_scale, diffs, candidates, n); break;
+		case 2: offerRowSorted<2, Codec>(s, c, num_rankings, quantization_scale, diffs, candidates, n); break;
+		case 3: offerRowSorted<3, Codec>(s, c, num_rankings, quantization_scale, diffs, candidates, n); break;
+		case 4: offerRowSorted<4, Codec>(s, c, num_rankings, quantization_scale, diffs, candidates, n); break;
+		case 5: offerRowSorted<5, Codec>(s, c, num_rankings, quantization_scale, diffs, candidates, n); break;
+		case 6: offerRowSorted<6, Codec>(s, c, num_rankings, quantization_scale, diffs, candidates, n); break;
+		case 7: offerRowSorted<7, Codec>(s, c, num_rankings, quantization_scale, diffs, candidates, n); break;
+		case 8: offerRowSorted<8, Codec>(s, c, num_rankings, quantization_scale, diffs, candidates, n); break;
+		default: offerRowSorted<0, Codec>(s, c, num_rankings, quantization_scale, diffs, candidates, n); break;
+	}
+}
+
+template<class Codec>
+void RankingBuffer::finishAs(int first_row, int last_row)
+{
+	//Heapsort each pixel in place: take the lowest ranked entry off the top and put it at the end, over and over,
+	//which leaves the best entry at rank 0.
+	typedef typename Codec::stored T;
+	for(size_t pixel = pixelIndex(first_row, 0); pixel < pixelIndex(last_row, 0); ++pixel){
+		T *s = (T *) scores + pixel * num_rankings;
+		Pixel *c = colors + pixel * num_rankings;
+		unsigned int *a = arrivals + pixel * num_rankings;
+		for(int size = num_rankings; size > 1; --size){
+			T lowest_score = s[0];
+			Pixel lowest_color = c[0];
+			unsigned int lowest_arrival = a[0];
+			siftDown(s, c, a, size - 1, 0, s[size - 1], c[size - 1], a[size - 1]);
+			s[size - 1] = lowest_score;
+			c[size - 1] = lowest_color;
+			a[size - 1] = lowest_arrival;
+		}
+	}
+}
+
+template<class Codec>
+void RankingBuffer::scoresAtAs(size_t pixel, double *out) const
+{
+	const typename Codec::stored *s = (const typename Codec::stored *) scores + pixel * num_rankings;
+	for(int k = 0; k < num_rankings; ++k){
+		out[k] = Codec::decode(s[k], quantization_scale);
+	}
+}
+
+//Public----------------------------------------------------------------------------------------------------------------
+
+void RankingBuffer::offerRow(size_t first_pixel, const double *diffs, const Pixel *candidates, int n,
+                             unsigned int arrival)
+{
+	switch(score_precision){
+		case FLOAT_SCORES: offerRowAs<FloatScores>(first_pixel, diffs, candidates, n, arrival); break;
+		case QUANTIZED_SCORES: offerRowAs<QuantizedScores>(first_pixel, diffs, candidates, n, arrival); break;
+		default: offerRowAs<DoubleScores>(first_pixel, diffs, candidates, n, arrival); break;
+	}
+}
+
+void RankingBuffer::finish(int first_row, int last_row)
+{
+	if(chosen_strategy != HEAP){
+		return;
+	}
+	switch(score_precision){
+		case FLOAT_SCORES: finishAs<FloatScores>(first_row, last_row); break;
+		case QUANTIZED_SCORES: finishAs<QuantizedScores>(first_row, last_row); break;
+		default: finishAs<DoubleScores>(first_row, last_row); break;
+	}
+}
+
+void RankingBuffer::scoresAt(size_t pixel, double *out) const
+{
+	switch(score_precision){
+		case FLOAT_SCORES: scoresAtAs<FloatScores>(pixel, out); break;
+		case QUANTIZED_SCORES: scoresAtAs<QuantizedScores>(pixel, out); break;
+		default: scoresAtAs<DoubleScores>(pixel, out); break;
+	}
+}
+
+//DifferenceRecord-----------------------------------------------------------------------------------------------------
+
+void allocateRankings(DifferenceRecord &dr, int height, int width)
+{
+	dr.rankings.allocate(height, width, dr.num_pixels_to_rank, dr.score_precision,
+	                     DifferenceFunctions::scoreBound(dr.function_id));
+}
+
+void rankFrameRows(std::vector<DifferenceRecord> &drs, DifferenceFunctions::FusedRowFunction scoreRow,
+                   const Image &average, const Image &frame, int first_row, int last_row, unsigned int arrival)
+{
+	int width = frame.width;
+	std::vector<double> scoreBuffer((size_t) DifferenceFunctions::NUM_FUNCTIONS * width);
+	double *scores[DifferenceFunctions::NUM_FUNCTIONS];
+	for(int id = 0; id < DifferenceFunctions::NUM_FUNCTIONS; ++id){
+		scores[id] = &scoreBuffer[(size_t) id * width];
+	}
+	for(int i = first_row; i < last_row; ++i){
+		const Pixel *frameRow = frame.map[i];
+		scoreRow(average.map[i], frameRow, scores, width);
+		for(size_t drs_index = 0; drs_index < drs.size(); ++drs_index){
+			RankingBuffer &rankings = drs[drs_index].rankings;
+			rankings.offerRow(rankings.pixelIndex(i, 0), scores[drs[drs_index].function_id], frameRow, width, arrival);
+		}
+	}
+}
@@ -0,0 +1,128 @@
+// LeastAverageImage
+// Andrew Eckel
+// differencerecord.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef DIFFERENCERECORD_H
+#define DIFFERENCERECORD_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "ppm_functions.h"
+#include "differencefunctions.h"
+
+//The top ranked scores, and the colors that earned them, for every pixel of the output.
+//Rather than a vector per pixel, everything lives in two contiguous aligned planes: one of scores and one of colors.
+//Both are indexed as [pixel][rank], where pixel = row * width + column and rank 0 is the biggest difference.
+//
+//How candidates are kept depends on how many rankings there are:
+//  SORTED_INSERT  each pixel's rankings are always in order, and a new candidate is inserted by shifting
+//                 everything below it down one rank. That is O(K) per accepted candidate, but with no bookkeeping,
+//                 so it is the fastest choice for small K (and for K of 8 or less, the loops are fully unrolled).
+//  HEAP           each pixel's rankings are a min-heap with the lowest ranked candidate on top, so accepting a
+//                 candidate is O(log K). The heaps are sorted into rank order once, by finish(), before rendering.
+//Either way, the final rankings are exactly the same.
+//
+//How scores are stored depends on the precision:
+//  DOUBLE_SCORES     8 bytes per score, exactly as computed.
+//  FLOAT_SCORES      4 bytes per score, rounded to the nearest float.
+//  QUANTIZED_SCORES  2 bytes per score, as a fraction of score_bound with about three significant digits.
+//Rounding never changes the order of two scores, but it can make two different scores equal.
+//Those are ranked like any other tie: the candidate that arrived first keeps the better rank.
+class RankingBuffer
+{
+public:
+	enum Strategy { AUTOMATIC, SORTED_INSERT, HEAP };
+	enum Precision { DOUBLE_SCORES, FLOAT_SCORES, QUANTIZED_SCORES };
+
+	RankingBuffer();
+	~RankingBuffer();
+	RankingBuffer(RankingBuffer &&other) noexcept;
+	RankingBuffer &operator=(RankingBuffer &&other) noexcept;
+	RankingBuffer(const RankingBuffer &) = delete;
+	RankingBuffer &operator=(const RankingBuffer &) = delete;
+
+	//Make room for num_rankings entries per pixel. Every score starts at 0 and every color starts white.
+	//score_bound is the largest score that will ever be offered. It is only used by QUANTIZED_SCORES.
+	//AUTOMATIC picks the strategy from num_rankings.
+	void allocate(int height, int width, int num_rankings, Precision precision = DOUBLE_SCORES,
+	              double score_bound = 0.0, Strategy strategy = AUTOMATIC);
+	void release();
+
+	int rankings() const { return num_rankings; }
+	Strategy strategy() const { return chosen_strategy; }
+	Precision precision() const { return score_precision; }
+	size_t pixelIndex(int i, int j) const { return (size_t) i * width + j; }
+	//A pixel's scores, converted back to doubles, and its colors. They are only in rank order after finish().
+	void scoresAt(size_t pixel, double *out) const;
+	const Pixel *colorsAt(size_t pixel) const { return colors + pixel * num_rankings; }
+
+	//Offer a row of candidates: diffs[j] and colors[j] for pixel first_pixel + j, for j from 0 to n - 1.
+	//arrival must increase from one call to the next for the same pixels (the frame number works).
+	//A candidate's score has to beat the lowest ranked score to get in. It has to be strictly bigger to move ahead
+	//of another one, so between equal scores the one that arrived first keeps the better rank.
+	void offerRow(size_t first_pixel, const double *diffs, const Pixel *colors, int n, unsigned int arrival);
+
+	//Put the rankings of rows [first_row, last_row) in rank order. Call it once every candidate has been offered.
+	//Rows are independent, so different threads may finish different rows.
+	void finish(int first_row, int last_row);
+
+	//The largest num_rankings that AUTOMATIC gives SORTED_INSERT.
+	static const int MAX_SORTED_INSERT_RANKINGS = 64;
+
+	//The number of bytes one score takes up.
+	static size_t scoreBytes(Precision precision);
+
+	//Save the rankings exactly as they are (finished or not), or load rankings saved by write into these ones,
+	//which must have been allocated the same way. Both return false if the file can't be written or read.
+	//read also returns false, without changing anything, if the saved rankings were allocated differently.
+	bool write(FILE *file) const;
+	bool read(FILE *file);
+	//The number of bytes write writes.
+	size_t writtenBytes() const;
+
+private:
+	//Codec is one of the score storage types in differencerecord.cpp.
+	template<class Codec> void offerRowAs(size_t first_pixel, const double *diffs, const Pixel *candidates, int n,
+	                                      unsigned int arrival);
+	template<class Codec> void finishAs(int first_row, int last_row);
+	template<class Codec> void scoresAtAs(size_t pixel, double *out) const;
+
+	int height, width, num_rankings;
+	Strategy chosen_strategy;
+	Precision score_precision;
+	double quantization_scale;
+	//One score per entry, stored as a double, a float, or an unsigned short, depending on score_precision.
+	void *scores;
+	Pixel *colors;
+	//HEAP only: when each entry arrived, to keep ties in arrival order.
+	unsigned int *arrivals;
+};
+
+typedef struct
+{
+	std::string name;
+	DifferenceFunctions::FunctionId function_id;
+	unsigned int num_pixels_to_rank;
+	bool invert_scores;
+	std::vector<double> score_powers;
+	std::vector<int> rankings_to_save;
+	RankingBuffer::Precision score_precision;
+	RankingBuffer rankings;
+} DifferenceRecord;
+
+//(Re)allocate a record's rankings for a height by width image, with its number of rankings and its score precision.
+void allocateRankings(DifferenceRecord &dr, int height, int width);
+
+//Score rows [first_row, last_row) of frame against the same rows of average with every record's difference function
+//(scoreRow must be the fused row function for all of them), and offer the scores to each record's rankings.
+//The rankings, average, and frame all number their rows the same way. arrival is passed on to offerRow.
+void rankFrameRows(std::vector<DifferenceRecord> &drs, DifferenceFunctions::FusedRowFunction scoreRow,
+                   const Image &average, const Image &frame, int first_row, int last_row, unsigned int arrival);
+
+#endif //DIFFERENCERECORD_H
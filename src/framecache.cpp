@@ -0,0 +1,62 @@
+// LeastAverageImage
+// Andrew Eckel
+// framecache.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#include "framecache.h"
+
+FrameCache::FrameCache(size_t budget_bytes, int num_frames)
+{
+	this->budget_bytes = budget_bytes;
+	bytes_used = 0;
+	frames_held = 0;
+	frames.resize(num_frames);
+	held.resize(num_frames, false);
+}
+
+FrameCache::~FrameCache()
+{
+	for(size_t x = 0; x < frames.size(); ++x){
+		if(held[x]){
+			deleteImage(frames[x]);
+		}
+	}
+}
+
+bool FrameCache::store(int x, Image img)
+{
+	size_t size = imageBytes(img);
+	if(x < 0 || x >= (int) frames.size() || held[x] || bytes_used + size > budget_bytes){
+		return false;
+	}
+	frames[x] = img;
+	held[x] = true;
+	bytes_used += size;
+	++frames_held;
+	return true;
+}
+
+bool FrameCache::take(int x, Image *img)
+{
+	if(x < 0 || x >= (int) frames.size() || !held[x]){
+		return false;
+	}
+	*img = frames[x];
+	held[x] = false;
+	bytes_used -= imageBytes(frames[x]);
+	--frames_held;
+	return true;
+}
+
+size_t FrameCache::imageBytes(const Image &img)
+{
+	//Memory-mapped frames are counted too: their pages stay resident for as long as the mapping does.
+	return imageBytes(img.height, img.width);
+}
+
+size_t FrameCache::imageBytes(int height, int width)
+{
+	return sizeof(Pixel) * (size_t) height * width + sizeof(Pixel *) * height;
+}
@@ -0,0 +1,50 @@
+// LeastAverageImage
+// Andrew Eckel
+// framecache.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <vector>
+#include <stddef.h>
+
+#include "ppm_functions.h"
+
+//Holds on to decoded (and resized) input frames between the averaging phase and the differentiating phase,
+//so that the frames that fit in the memory budget only have to be read from disk once.
+//Frames are kept first come, first served: once the budget is used up, later frames are simply not kept.
+class FrameCache
+{
+public:
+	FrameCache(size_t budget_bytes, int num_frames);
+	~FrameCache();
+	FrameCache(const FrameCache &) = delete;
+	FrameCache &operator=(const FrameCache &) = delete;
+
+	//Offer frame x to the cache. Returns true if the cache kept it, in which case the cache now owns the image
+	//and the caller must not delete it. Returns false if it doesn't fit, and the caller still owns it.
+	bool store(int x, Image img);
+
+	//If frame x is in the cache, remove it from the cache, put it in img, and return true.
+	//The caller then owns the image and deletes it as usual.
+	bool take(int x, Image *img);
+
+	bool has(int x) const { return x >= 0 && x < (int) held.size() && held[x]; }
+	int framesHeld() const { return frames_held; }
+	size_t bytesUsed() const { return bytes_used; }
+
+	//The number of bytes an image takes up, for budgeting purposes.
+	static size_t imageBytes(const Image &img);
+	static size_t imageBytes(int height, int width);
+
+private:
+	size_t budget_bytes, bytes_used;
+	int frames_held;
+	std::vector<Image> frames;
+	std::vector<bool> held;
+};
+
+#endif //FRAMECACHE_H
@@ -0,0 +1,237 @@
+// LeastAverageImage
+// Andrew Eckel
+// framecontainer.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#define _FILE_OFFSET_BITS 64
+
+#include "framecontainer.h"
+#include "utility.h"
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//Parse a P6 header from the size bytes at header, which may go on past the end of the header. Comments are allowed
+//anywhere before the maximum value, as in any PPM file. Returns the length of the header, or 0 if it isn't a P6
+//header (or it doesn't all fit in size bytes).
+static size_t parseP6Header(const unsigned char *header, size_t size, int *height, int *width, int *imax)
+{
+	if(size < 2 || header[0] != 'P' || header[1] != '6'){
+		return 0;
+	}
+	size_t pos = 2;
+	long long fields[3];
+	for(int f = 0; f < 3; ++f){
+		//Whitespace and comments, then a number.
+		while(pos < size && (isspace(header[pos]) || header[pos] == '#')){
+			if(header[pos] == '#'){
+				while(pos < size && header[pos] != '\n'){
+					++pos;
+				}
+			}
+			else{
+				++pos;
+			}
+		}
+		if(pos >= size || !isdigit(header[pos])){
+			return 0;
+		}
+		fields[f] = 0;
+		while(pos < size && isdigit(header[pos]) && fields[f] < 1000000000){
+			fields[f] = fields[f] * 10 + (header[pos] - '0');
+			++pos;
+		}
+	}
+	//Exactly one whitespace character separates the maximum value from the raster.
+	if(pos >= size || !isspace(header[pos])){
+		return 0;
+	}
+	*width = (int) fields[0];
+	*height = (int) fields[1];
+	*imax = (int) fields[2];
+	return pos + 1;
+}
+
+//Headers longer than this aren't expected (only a comment could make one this long).
+static const size_t MAX_HEADER_SIZE = 4096;
+
+FrameContainer::FrameContainer(const std::string &filename)
+{
+	this->filename = filename;
+	mapping = NULL;
+	mapping_size = 0;
+	file = fopen(filename.c_str(), "rb");
+	if(file == NULL){
+		std::cerr << "ERROR: Can't open container file " << filename << "\n";
+		throw RunError();
+	}
+	//The destructor isn't run if the constructor throws, so the file (and the mapping) are let go of here then.
+	try{
+		if(seek64(file, 0, SEEK_END) != 0){
+			std::cerr << "ERROR: Can't find the size of container file " << filename << "\n";
+			throw RunError();
+		}
+		const long long file_size = tell64(file);
+
+#ifndef _WIN32
+		if(file_size > 0){
+			void *mapped = mmap(NULL, (size_t) file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+			if(mapped != MAP_FAILED){
+				mapping = (unsigned char *) mapped;
+				mapping_size = (size_t) file_size;
+				madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+			}
+		}
+#endif
+
+		//Walk through the headers. Each raster runs right up to the next header.
+		std::vector<unsigned char> buffer(MAX_HEADER_SIZE);
+		long long offset = 0;
+		while(offset < file_size){
+			size_t available = (size_t) std::min((long long) MAX_HEADER_SIZE, file_size - offset);
+			const unsigned char *header;
+			if(mapping != NULL){
+				header = mapping + offset;
+			}
+			else{
+				if(seek64(file, offset) != 0 || fread(&buffer[0], 1, available, file) != available){
+					std::cerr << "ERROR: Can't read container file " << filename << "\n";
+					throw RunError();
+				}
+				header = &buffer[0];
+			}
+			Entry entry;
+			int imax;
+			size_t header_size = parseP6Header(header, available, &entry.height, &entry.width, &imax);
+			if(header_size == 0 || entry.height <= 0 || entry.width <= 0){
+				//Trailing whitespace after the last frame is fine; anything else isn't.
+				size_t rest = 0;
+				while(rest < available && isspace(header[rest])){
+					++rest;
+				}
+				if(entries.size() > 0 && (long long) rest == file_size - offset){
+					break;
+				}
+				std::cerr << "ERROR: " << filename << " is not a container of P6 images (frame " << entries.size() + 1 << ")\n";
+				throw RunError();
+			}
+			if(imax != 255){
+				std::cerr << "ERROR: Frame " << entries.size() + 1 << " of container file " << filename
+					<< " has a maximum value of " << imax << ", not 255. Make containers with the pack command.\n";
+				throw RunError();
+			}
+			entry.raster_offset = offset + (long long) header_size;
+			offset = entry.raster_offset + 3LL * entry.height * entry.width;
+			if(offset > file_size){
+				std::cerr << "ERROR: Container file " << filename << " ends in the middle of frame " << entries.size() + 1 << "\n";
+				throw RunError();
+			}
+			entries.push_back(entry);
+		}
+		if(entries.empty()){
+			std::cerr << "ERROR: No frames found in container file " << filename << "\n";
+			throw RunError();
+		}
+	} catch(...){
+#ifndef _WIN32
+		if(mapping != NULL){
+			munmap(mapping, mapping_size);
+		}
+#endif
+		fclose(file);
+		throw;
+	}
+}
+
+FrameContainer::~FrameContainer()
+{
+#ifndef _WIN32
+	if(mapping != NULL){
+		munmap(mapping, mapping_size);
+	}
+#endif
+	fclose(file);
+}
+
+Image FrameContainer::readFrame(int x)
+{
+	return readFrameRows(x, 0, entries[x].height);
+}
+
+Image FrameContainer::readFrameRows(int x, int first_row, int num_rows)
+{
+	const Entry &entry = entries[x];
+	if(first_row < 0 || num_rows <= 0 || first_row + num_rows > entry.height){
+		std::cerr << "ERROR: Rows " << first_row << " to " << first_row + num_rows - 1 << " are outside frame " << x + 1
+			<< " of container file " << filename << "\n";
+		throw RunError();
+	}
+	const long long offset = entry.raster_offset + 3LL * first_row * entry.width;
+	Image img;
+	if(mapping != NULL){
+		//A view of the mapping: only the row pointers are allocated, and mapping stays NULL in the image,
+		//so deleteImage frees the row pointers and leaves the container's mapping alone.
+		img.map = (Pixel **) alignedMalloc(sizeof(Pixel *) * num_rows);
+		if(img.map == NULL){
+			std::cerr << "ERROR: Out of memory reading frame " << x + 1 << " of container file " << filename << "\n";
+			throw RunError();
+		}
+		img.data = (Pixel *) (mapping + offset);
+		for(int i = 0; i < num_rows; ++i){
+			img.map[i] = img.data + (size_t) i * entry.width;
+		}
+		img.height = num_rows;
+		img.width = entry.width;
+		img.mapping = NULL;
+		img.mapping_size = 0;
+		countBytesRead(sizeof(Pixel) * (size_t) num_rows * entry.width);
+		return img;
+	}
+	img = createImageUninitialized(num_rows, entry.width);
+	const size_t pixels = (size_t) num_rows * entry.width;
+	std::lock_guard<std::mutex> lock(file_mutex);
+	if(seek64(file, offset) != 0 || fread(img.data, sizeof(Pixel), pixels, file) != pixels){
+		std::cerr << "ERROR: Can't read frame " << x + 1 << " of container file " << filename << "\n";
+		deleteImage(img);
+		throw RunError();
+	}
+	countBytesRead(sizeof(Pixel) * pixels);
+	return img;
+}
+
+void FrameContainer::pack(const std::vector<std::string> &filenames, const std::string &container_filename)
+{
+	FILE *out = fopen(container_filename.c_str(), "wb");
+	if(out == NULL){
+		std::cerr << "ERROR: Can't create container file " << container_filename << "\n";
+		throw RunError();
+	}
+	//A container cut short would be rejected later (or, if it's cut between two frames, taken as whole), so if any
+	//frame can't be read or the file can't be written, it's removed.
+	try{
+		for(size_t x = 0; x < filenames.size(); ++x){
+			ScopedImage img(readImage(filenames[x]));
+			fprintf(out, "P6\n%d %d\n255\n", img.get().width, img.get().height);
+			writeImageRows(out, img);
+			std::cout << "Packed image #" << x + 1 << " of " << filenames.size() << ": " << filenames[x] << std::endl;
+		}
+	} catch(...){
+		fclose(out);
+		remove(container_filename.c_str());
+		throw;
+	}
+	try{
+		endImageFile(out, container_filename);
+	} catch(...){
+		remove(container_filename.c_str());
+		throw;
+	}
+}
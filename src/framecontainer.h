@@ -0,0 +1,65 @@
+// LeastAverageImage
+// Andrew Eckel
+// framecontainer.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef FRAMECONTAINER_H
+#define FRAMECONTAINER_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <stdio.h>
+#include <stddef.h>
+
+#include "ppm_functions.h"
+
+//All the frames of an album in one file, so reading them doesn't mean opening (and statting) thousands of files.
+//A container is nothing more than P6 images, each with a maximum value of 255, one right after another
+//(which is how the netpbm tools store several images in one file, too), made from an album or list by pack().
+//Opening one finds every frame's size and where its raster starts, by reading the headers one after another.
+//Where the OS allows, the whole file is memory-mapped once, and frames are handed out as views of the mapping
+//without any copying. Otherwise, each frame is read from the file.
+class FrameContainer
+{
+public:
+	//Open a container and find its frames. Exits with an error if it can't be opened or isn't a container.
+	explicit FrameContainer(const std::string &filename);
+	~FrameContainer();
+	FrameContainer(const FrameContainer &) = delete;
+	FrameContainer &operator=(const FrameContainer &) = delete;
+
+	int frames() const { return (int) entries.size(); }
+	//Height first, width second, like readHeightAndWidth.
+	std::pair<int, int> heightAndWidth(int x) const { return std::make_pair(entries[x].height, entries[x].width); }
+
+	//Frame x, or num_rows of its rows starting with first_row, like readImage and readImageRows.
+	//The result is released with deleteImage as usual, and must be, before the container is destroyed.
+	//These may be called from several threads at once.
+	Image readFrame(int x);
+	Image readFrameRows(int x, int first_row, int num_rows);
+
+	//Read each of filenames (rescaling any with a maximum value other than 255) and write them all into one container.
+	static void pack(const std::vector<std::string> &filenames, const std::string &container_filename);
+
+private:
+	typedef struct
+	{
+		long long raster_offset;
+		int height, width;
+	} Entry;
+
+	std::string filename;
+	std::vector<Entry> entries;
+	FILE *file;
+	//When the whole file is mapped, mapping is where, and reading a frame needs nothing else.
+	unsigned char *mapping;
+	size_t mapping_size;
+	//Otherwise, reads from file take turns.
+	std::mutex file_mutex;
+};
+
+#endif //FRAMECONTAINER_H
@@ -0,0 +1,106 @@
+// LeastAverageImage
+// Andrew Eckel
+// framepipeline.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#include "framepipeline.h"
+
+#include <algorithm>
+
+FramePipeline::FramePipeline(const std::vector<int> &frames, const FrameLoader &loader, int num_decoders, int queue_depth)
+{
+	this->frames = frames;
+	this->loader = loader;
+	next_to_decode = 0;
+	next_to_deliver = 0;
+	stopping = false;
+	byte_totals = currentByteTotals();
+
+	if(num_decoders > 0){
+		//There is no point in having more decoders than slots for them to fill.
+		queue_depth = std::max(queue_depth, 1);
+		num_decoders = std::min(num_decoders, queue_depth);
+		ring.resize(queue_depth);
+		for(size_t s = 0; s < ring.size(); ++s){
+			ring[s].ready = false;
+		}
+		for(int d = 0; d < num_decoders; ++d){
+			decoders.push_back(std::thread(&FramePipeline::decoderLoop, this));
+		}
+	}
+}
+
+FramePipeline::~FramePipeline()
+{
+	{
+		std::lock_guard<std::mutex> lock(ring_mutex);
+		stopping = true;
+	}
+	slot_freed.notify_all();
+	for(size_t d = 0; d < decoders.size(); ++d){
+		decoders[d].join();
+	}
+	//Frames that were read ahead but never asked for.
+	for(size_t s = 0; s < ring.size(); ++s){
+		if(ring[s].ready && !ring[s].error){
+			deleteImage(ring[s].img);
+		}
+	}
+}
+
+Image FramePipeline::next(int *x)
+{
+	if(decoders.empty()){
+		*x = frames[next_to_deliver++];
+		return loader(*x);
+	}
+
+	std::unique_lock<std::mutex> lock(ring_mutex);
+	Slot &slot = ring[next_to_deliver % ring.size()];
+	slot_filled.wait(lock, [&slot]() { return slot.ready; });
+	Image img = slot.img;
+	std::exception_ptr error = slot.error;
+	slot.ready = false;
+	slot.error = nullptr;
+	*x = frames[next_to_deliver++];
+	lock.unlock();
+	slot_freed.notify_all();
+	if(error){
+		std::rethrow_exception(error);
+	}
+	return img;
+}
+
+void FramePipeline::decoderLoop()
+{
+	countBytesInto(byte_totals);
+	std::unique_lock<std::mutex> lock(ring_mutex);
+	while(true){
+		//Position p goes in slot p % ring.size(), which is free once position p - ring.size() has been handed over.
+		slot_freed.wait(lock, [this]() {
+			return stopping || next_to_decode >= frames.size() || next_to_decode < next_to_deliver + ring.size();
+		});
+		if(stopping || next_to_decode >= frames.size()){
+			return;
+		}
+		size_t position = next_to_decode++;
+
+		lock.unlock();
+		Image img = Image();
+		std::exception_ptr error;
+		try{
+			img = loader(frames[position]);
+		} catch(...){
+			error = std::current_exception();
+		}
+		lock.lock();
+
+		Slot &slot = ring[position % ring.size()];
+		slot.img = img;
+		slot.error = error;
+		slot.ready = true;
+		slot_filled.notify_all();
+	}
+}
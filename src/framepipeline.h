@@ -0,0 +1,64 @@
+// LeastAverageImage
+// Andrew Eckel
+// framepipeline.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include "ppm_functions.h"
+
+//Reads frames ahead of the code that uses them, so the disk and the CPU can both stay busy.
+//Decoder threads load upcoming frames into a fixed ring of slots while the consumer takes them out with next(),
+//always in the order they were listed. A decoder waits whenever the ring is full, so no more than
+//queue_depth frames are ever waiting in memory.
+class FramePipeline
+{
+public:
+	//Loads (reads, and resizes if necessary) frame number x. Called on the decoder threads.
+	typedef std::function<Image(int)> FrameLoader;
+
+	//With num_decoders == 0, nothing is read ahead: next() simply loads the frame itself.
+	FramePipeline(const std::vector<int> &frames, const FrameLoader &loader, int num_decoders, int queue_depth);
+	~FramePipeline();
+	FramePipeline(const FramePipeline &) = delete;
+	FramePipeline &operator=(const FramePipeline &) = delete;
+
+	//Wait for the next frame in the list and hand it over. The caller owns the image and deletes it as usual.
+	//x receives the frame's number. If the loader threw while loading it, that's rethrown here instead.
+	Image next(int *x);
+
+	//True once every frame in the list has been handed over.
+	bool done() const { return next_to_deliver >= frames.size(); }
+
+private:
+	typedef struct
+	{
+		Image img;
+		std::exception_ptr error; //If the loader threw instead.
+		bool ready;
+	} Slot;
+
+	void decoderLoop();
+
+	std::vector<int> frames;
+	FrameLoader loader;
+	std::vector<Slot> ring;
+	size_t next_to_decode, next_to_deliver;
+	bool stopping;
+	std::mutex ring_mutex;
+	std::condition_variable slot_freed, slot_filled;
+	std::vector<std::thread> decoders;
+	ByteTotals *byte_totals; //The decoders count what they read for the thread that made the pipeline.
+};
+
+#endif //FRAMEPIPELINE_H
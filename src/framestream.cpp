@@ -0,0 +1,284 @@
+// LeastAverageImage
+// Andrew Eckel
+// framestream.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#define _FILE_OFFSET_BITS 64
+
+#include "framestream.h"
+#include "utility.h"
+
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+//YUV to RGB conversion-------------------------------------------------------------------------------------------------
+
+//Each channel is a sum of table entries, in fixed point with 16 fraction bits, like
+//R = y[Y] + r_v[V], G = y[Y] + g_u[U] + g_v[V], B = y[Y] + b_u[U]. (y includes the 0.5 for rounding.)
+typedef struct
+{
+	int32_t y[256], r_v[256], g_u[256], g_v[256], b_u[256];
+} YuvTables;
+
+static YuvTables makeYuvTables(bool full_range)
+{
+	//BT.601. Limited range stretches Y from 16-235 and U and V from 16-240 to the full 0-255.
+	const double y_scale = full_range ? 1.0 : 255.0 / 219.0;
+	const double y_offset = full_range ? 0.0 : 16.0;
+	const double c_scale = full_range ? 1.0 : 255.0 / 224.0;
+	const double one = 65536.0;
+	YuvTables t;
+	for(int x = 0; x < 256; ++x){
+		double c = (x - 128) * c_scale;
+		t.y[x] = (int32_t) lround(((x - y_offset) * y_scale + 0.5) * one);
+		t.r_v[x] = (int32_t) lround(1.402 * c * one);
+		t.g_u[x] = (int32_t) lround(-0.344136 * c * one);
+		t.g_v[x] = (int32_t) lround(-0.714136 * c * one);
+		t.b_u[x] = (int32_t) lround(1.772 * c * one);
+	}
+	return t;
+}
+
+static const YuvTables &yuvTables(bool full_range)
+{
+	static const YuvTables limited = makeYuvTables(false);
+	static const YuvTables full = makeYuvTables(true);
+	return full_range ? full : limited;
+}
+
+static inline unsigned char clampFixed(int32_t value)
+{
+	if(value < 0){
+		return 0;
+	}
+	value >>= 16;
+	return (value > 255) ? 255 : (unsigned char) value;
+}
+
+//FrameStream-----------------------------------------------------------------------------------------------------------
+
+bool FrameStream::parseFormat(const std::string &name, Format *format)
+{
+	if(name == "y4m"){
+		*format = Y4M;
+		return true;
+	}
+	if(name == "rgb24"){
+		*format = RGB24;
+		return true;
+	}
+	return false;
+}
+
+FrameStream::FrameStream(const std::string &path, Format format, int width, int height)
+{
+	this->path = path;
+	this->format = format;
+	spool = NULL;
+	frames_read = 0;
+	chroma_shift_x = 0;
+	chroma_shift_y = 0;
+	monochrome = false;
+	full_range = false;
+	if(path == "-"){
+		file = stdin;
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
+	}
+	else{
+		file = fopen(path.c_str(), "rb");
+		if(file == NULL){
+			std::cerr << "ERROR: Can't open input stream " << path << "\n";
+			throw RunError();
+		}
+	}
+
+	//The destructor isn't run if the constructor throws, so the file is closed here then.
+	try{
+		if(format == Y4M){
+			readY4MHeader();
+		}
+		else{
+			frame_width = width;
+			frame_height = height;
+			if(frame_width <= 0 || frame_height <= 0){
+				std::cerr << "ERROR: Invalid frame size for RGB24 stream " << path << ": " << width << " by " << height << "\n";
+				throw RunError();
+			}
+			raw.resize((size_t) frame_width * frame_height * 3);
+		}
+	} catch(...){
+		if(file != stdin){
+			fclose(file);
+		}
+		throw;
+	}
+}
+
+FrameStream::~FrameStream()
+{
+	if(file != NULL && file != stdin){
+		fclose(file);
+	}
+	if(spool != NULL && fclose(spool) != 0){
+		std::cout << "WARNING: Couldn't finish writing spool file " << spool_filename << std::endl;
+	}
+}
+
+void FrameStream::readY4MHeader()
+{
+	int c;
+	while((c = fgetc(file)) != EOF && c != '\n'){
+		header += (char) c;
+		if(header.size() > 4096){
+			break;
+		}
+	}
+	if(c != '\n' || header.compare(0, 10, "YUV4MPEG2 ") != 0){
+		std::cerr << "ERROR: " << path << " is not a YUV4MPEG2 stream\n";
+		throw RunError();
+	}
+	frame_width = 0;
+	frame_height = 0;
+	std::string colorspace = "420jpeg";
+	std::istringstream tokens(header.substr(10));
+	std::string token;
+	while(tokens >> token){
+		switch(token[0]){
+			case 'W': frame_width = atoi(token.c_str() + 1); break;
+			case 'H': frame_height = atoi(token.c_str() + 1); break;
+			case 'C': colorspace = token.substr(1); break;
+			case 'X':
+				if(token == "XCOLORRANGE=FULL"){
+					full_range = true;
+				}
+				break;
+			default: break; //Frame rate, interlacing, and aspect ratio don't matter here.
+		}
+	}
+	if(colorspace == "420jpeg" || colorspace == "420paldv" || colorspace == "420mpeg2" || colorspace == "420"){
+		chroma_shift_x = 1;
+		chroma_shift_y = 1;
+	}
+	else if(colorspace == "422"){
+		chroma_shift_x = 1;
+	}
+	else if(colorspace == "mono"){
+		monochrome = true;
+	}
+	else if(colorspace != "444"){
+		std::cerr << "ERROR: Unsupported Y4M color space C" << colorspace << " in " << path
+			<< " (only 8 bit 420, 422, 444, and mono are supported)\n";
+		throw RunError();
+	}
+	if(frame_width <= 0 || frame_height <= 0){
+		std::cerr << "ERROR: Invalid frame size in Y4M header of " << path << "\n";
+		throw RunError();
+	}
+	header += '\n';
+	size_t luma = (size_t) frame_width * frame_height;
+	size_t chroma = monochrome ? 0 : (size_t) ((frame_width + (1 << chroma_shift_x) - 1) >> chroma_shift_x)
+		* ((frame_height + (1 << chroma_shift_y) - 1) >> chroma_shift_y);
+	raw.resize(luma + 2 * chroma);
+}
+
+void FrameStream::spoolTo(const std::string &filename)
+{
+	spool_filename = filename;
+	spool = fopen(filename.c_str(), "wb");
+	if(spool == NULL || (format == Y4M && fwrite(header.data(), 1, header.size(), spool) != header.size())){
+		std::cerr << "ERROR: Can't write spool file " << filename << "\n";
+		throw RunError();
+	}
+}
+
+bool FrameStream::next(Image *img, ThreadPool &pool)
+{
+	if(format == Y4M){
+		//Every frame starts with a line like "FRAME" followed by optional parameters.
+		std::string frame_header;
+		int c;
+		while((c = fgetc(file)) != EOF && c != '\n' && frame_header.size() < 4096){
+			frame_header += (char) c;
+		}
+		if(frame_header.empty() && c == EOF){
+			return false;
+		}
+		if(frame_header.compare(0, 5, "FRAME") != 0){
+			std::cerr << "ERROR: Bad frame header after frame " << frames_read << " of " << path << "\n";
+			throw RunError();
+		}
+	}
+	size_t got = fread(&raw[0], 1, raw.size(), file);
+	countBytesRead(got);
+	if(got != raw.size()){
+		if(got > 0 || format == Y4M){
+			std::cout << "WARNING: The stream " << path << " ended in the middle of frame " << frames_read + 1
+				<< ", which was left out." << std::endl;
+		}
+		return false;
+	}
+	if(spool != NULL){
+		if((format == Y4M && fwrite("FRAME\n", 1, 6, spool) != 6) || fwrite(&raw[0], 1, raw.size(), spool) != raw.size()){
+			std::cerr << "ERROR: Can't write spool file " << spool_filename << "\n";
+			throw RunError();
+		}
+		countBytesWritten(raw.size());
+	}
+
+	*img = createImageUninitialized(frame_height, frame_width);
+	if(format == RGB24){
+		memcpy(img->data, &raw[0], raw.size());
+	}
+	else{
+		const Image &converted = *img;
+		pool.parallelForBands(0, frame_height, [this, &converted](int first_row, int last_row){
+			convertRows(converted, first_row, last_row);
+		});
+	}
+	++frames_read;
+	return true;
+}
+
+void FrameStream::convertRows(const Image &img, int first_row, int last_row) const
+{
+	const YuvTables &t = yuvTables(full_range);
+	const int chroma_width = (frame_width + (1 << chroma_shift_x) - 1) >> chroma_shift_x;
+	const int chroma_height = (frame_height + (1 << chroma_shift_y) - 1) >> chroma_shift_y;
+	const unsigned char *y_plane = &raw[0];
+	const unsigned char *u_plane = y_plane + (size_t) frame_width * frame_height;
+	const unsigned char *v_plane = u_plane + (size_t) chroma_width * chroma_height;
+	for(int i = first_row; i < last_row; ++i){
+		const unsigned char *y_row = y_plane + (size_t) i * frame_width;
+		Pixel *out = img.map[i];
+		if(monochrome){
+			for(int j = 0; j < frame_width; ++j){
+				unsigned char value = clampFixed(t.y[y_row[j]]);
+				out[j].r = value;
+				out[j].g = value;
+				out[j].b = value;
+			}
+			continue;
+		}
+		const unsigned char *u_row = u_plane + (size_t) (i >> chroma_shift_y) * chroma_width;
+		const unsigned char *v_row = v_plane + (size_t) (i >> chroma_shift_y) * chroma_width;
+		for(int j = 0; j < frame_width; ++j){
+			const int32_t y = t.y[y_row[j]];
+			const unsigned char u = u_row[j >> chroma_shift_x];
+			const unsigned char v = v_row[j >> chroma_shift_x];
+			out[j].r = clampFixed(y + t.r_v[v]);
+			out[j].g = clampFixed(y + t.g_u[u] + t.g_v[v]);
+			out[j].b = clampFixed(y + t.b_u[u]);
+		}
+	}
+}
@@ -0,0 +1,71 @@
+// LeastAverageImage
+// Andrew Eckel
+// framestream.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef FRAMESTREAM_H
+#define FRAMESTREAM_H
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "ppm_functions.h"
+#include "threadpool.h"
+
+//Reads frames one after another from a video stream on stdin, a named pipe, or a file, instead of from PPM files.
+//Two formats are understood:
+//  Y4M    YUV4MPEG2, as written by ffmpeg -f yuv4mpegpipe and most other video tools. 8 bit 4:2:0, 4:2:2, 4:4:4,
+//         and monochrome streams are converted to RGB with the BT.601 matrix, in limited (16-235) range unless the
+//         header says XCOLORRANGE=FULL. Chroma is taken from the nearest sample; interlacing is ignored.
+//  RGB24  raw frames of width * height * 3 bytes, R, G, B, with nothing in between. The size has to be given.
+//A stream can only be read once, so everything read can also be copied to a spool file, which is itself a stream
+//of the same format that can be opened again for a second pass. For Y4M 4:2:0, that's half the size of PPM files.
+class FrameStream
+{
+public:
+	enum Format { Y4M, RGB24 };
+
+	//Open a stream. "-" means stdin. For Y4M, width and height are ignored, since the stream's header gives them.
+	//Exits with an error if the stream can't be opened or its header can't be understood.
+	FrameStream(const std::string &path, Format format, int width, int height);
+	~FrameStream();
+	FrameStream(const FrameStream &) = delete;
+	FrameStream &operator=(const FrameStream &) = delete;
+
+	int height() const { return frame_height; }
+	int width() const { return frame_width; }
+	int framesRead() const { return frames_read; }
+
+	//Read the next frame and convert it to RGB, with the rows split over the pool's threads.
+	//Returns false, with img untouched, at the end of the stream.
+	bool next(Image *img, ThreadPool &pool);
+
+	//From now on, also copy the stream to filename (which is replaced). Call it before reading any frames.
+	void spoolTo(const std::string &filename);
+
+	//Parse a format name from the settings file: "y4m" or "rgb24". Returns false if it's neither.
+	static bool parseFormat(const std::string &name, Format *format);
+
+private:
+	void readY4MHeader();
+	void convertRows(const Image &img, int first_row, int last_row) const;
+
+	FILE *file, *spool;
+	std::string path, spool_filename;
+	Format format;
+	int frame_height, frame_width;
+	//Y4M only: the header line, to start the spool with, how much smaller the chroma planes are, and whether
+	//the stream is full range.
+	std::string header;
+	int chroma_shift_x, chroma_shift_y;
+	bool monochrome, full_range;
+	//The bytes of one frame, as they are in the stream (planar YUV, or RGB).
+	std::vector<unsigned char> raw;
+	int frames_read;
+};
+
+#endif //FRAMESTREAM_H
@@ -0,0 +1,108 @@
+// LeastAverageImage
+// Andrew Eckel
+// inputmanifest.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#define _FILE_OFFSET_BITS 64
+
+#include "inputmanifest.h"
+#include "utility.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+//The first line of every manifest file, so that a file in some other format is never mistaken for one.
+//(Manifests from before modification times had nanoseconds are simply written again.)
+static const char *MANIFEST_MAGIC = "LAIMANIFEST2";
+
+InputManifest::InputManifest(const std::vector<std::string> &filenames, const std::string &manifest_filename, ThreadPool &pool)
+{
+	//What the manifest file says, by path.
+	std::unordered_map<std::string, Entry> known;
+	std::ifstream manifest;
+	if(!manifest_filename.empty()){
+		manifest.open(manifest_filename);
+	}
+	std::string line;
+	if(manifest.is_open() && std::getline(manifest, line) && line == MANIFEST_MAGIC){
+		while(std::getline(manifest, line)){
+			std::istringstream fields(line);
+			Entry entry;
+			std::string type;
+			if(fields >> entry.size >> entry.mtime >> entry.mtime_nsec >> type >> entry.header.height >> entry.header.width
+				>> entry.header.imax >> entry.header.raster_offset){
+				entry.header.p6 = (type == "P6");
+				//The path is everything after the tab that follows the raster offset, so it can contain spaces.
+				std::string path;
+				if(fields.get() == '\t' && std::getline(fields, path) && path.length() > 0){
+					known[path] = entry;
+				}
+			}
+		}
+	}
+	manifest.close();
+
+	//Every file is checked, and the ones that are new or have changed since the manifest was written are read.
+	entries.resize(filenames.size());
+	std::atomic<int> read_count(0);
+	pool.parallelForBands(0, (int) filenames.size(), [&](int band_begin, int band_end){
+		for(int x = band_begin; x < band_end; ++x){
+			struct stat st;
+			if(stat(filenames[x].c_str(), &st) != 0){
+				std::cerr << "ERROR: Can't open input file " << filenames[x] << "\n";
+				throw RunError();
+			}
+			Entry &entry = entries[x];
+			entry.size = (long long) st.st_size;
+			entry.mtime = (long long) st.st_mtime;
+			entry.mtime_nsec = Utility::modificationNanoseconds(st);
+			std::unordered_map<std::string, Entry>::const_iterator found = known.find(filenames[x]);
+			if(found != known.end() && found->second.size == entry.size && found->second.mtime == entry.mtime
+				&& found->second.mtime_nsec == entry.mtime_nsec){
+				entry.header = found->second.header;
+			}
+			else{
+				entry.header = readImageHeader(filenames[x]);
+				++read_count;
+			}
+		}
+	});
+	headers_read = read_count;
+
+	if(headers_read > 0 && !manifest_filename.empty() && !write(filenames, manifest_filename)){
+		std::cout << "WARNING: Could not write the input manifest " << manifest_filename << "\n";
+	}
+}
+
+bool InputManifest::write(const std::vector<std::string> &filenames, const std::string &manifest_filename) const
+{
+	//Written to a temporary file first, so an interrupted run never leaves half a manifest behind.
+	const std::string temp_filename = manifest_filename + ".tmp";
+	std::ofstream manifest(temp_filename);
+	if(!manifest){
+		return false;
+	}
+	manifest << MANIFEST_MAGIC << "\n";
+	for(size_t x = 0; x < entries.size(); ++x){
+		const Entry &entry = entries[x];
+		manifest << entry.size << " " << entry.mtime << " " << entry.mtime_nsec << " " << (entry.header.p6 ? "P6" : "other") << " "
+			<< entry.header.height << " " << entry.header.width << " " << entry.header.imax << " "
+			<< entry.header.raster_offset << "\t" << filenames[x] << "\n";
+	}
+	manifest.close();
+	if(!manifest){
+		remove(temp_filename.c_str());
+		return false;
+	}
+	remove(manifest_filename.c_str());
+	return rename(temp_filename.c_str(), manifest_filename.c_str()) == 0;
+}
@@ -0,0 +1,52 @@
+// LeastAverageImage
+// Andrew Eckel
+// inputmanifest.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef INPUTMANIFEST_H
+#define INPUTMANIFEST_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "ppm_functions.h"
+#include "threadpool.h"
+
+//The headers of all the input files: their dimensions, maximum values, and where their rasters start.
+//These are remembered in a manifest file (a text file with one line per input file: its size, modification time
+//(seconds, then nanoseconds), type, height, width, maximum value, raster offset, and path), so that a later run with
+//the same inputs only has to check each file's size and modification time instead of opening it and reading its header.
+//With the headers known, the readers can go straight to the rasters.
+class InputManifest
+{
+public:
+	//Find the headers of every one of filenames, from manifest_filename where it's up to date, and by reading the
+	//files where it isn't (in parallel, on the pool). If any had to be read, the manifest file is written again.
+	//With an empty manifest_filename, every header is simply read, and nothing is remembered.
+	//Exits with an error if an input file can't be found or read.
+	InputManifest(const std::vector<std::string> &filenames, const std::string &manifest_filename, ThreadPool &pool);
+
+	const ImageHeader &header(int x) const { return entries[x].header; }
+	//Height first, width second, like readHeightAndWidth.
+	std::pair<int, int> heightAndWidth(int x) const { return std::make_pair(entries[x].header.height, entries[x].header.width); }
+
+	//How many headers were not in the manifest file (or were out of date), and had to be read.
+	int headersRead() const { return headers_read; }
+
+private:
+	typedef struct
+	{
+		long long size, mtime, mtime_nsec;
+		ImageHeader header;
+	} Entry;
+
+	bool write(const std::vector<std::string> &filenames, const std::string &manifest_filename) const;
+
+	std::vector<Entry> entries;
+	int headers_read;
+};
+
+#endif //INPUTMANIFEST_H
@@ -0,0 +1,760 @@
+// LeastAverageImage
+// Andrew Eckel
+// jobrunner.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#include "jobrunner.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <memory>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "ppm_functions.h"
+#include "differencefunctions.h"
+#include "utility.h"
+#include "threadpool.h"
+#include "differencerecord.h"
+#include "framecache.h"
+#include "framepipeline.h"
+#include "outputrenderer.h"
+#include "tiledmode.h"
+#include "checkpoint.h"
+#include "averageaccumulator.h"
+#include "framestream.h"
+#include "framecontainer.h"
+#include "inputmanifest.h"
+#include "runreport.h"
+
+bool canShareFrames(const JobSettings &a, const JobSettings &b)
+{
+	return !a.stream_mode && !b.stream_mode
+		&& a.inputFilenames == b.inputFilenames
+		&& a.allow_resizing_and_cropping == b.allow_resizing_and_cropping
+		&& (!a.allow_resizing_and_cropping || a.average_dimensions_multiplier == b.average_dimensions_multiplier)
+		&& a.skip_averaging_phase == b.skip_averaging_phase && a.pre_averaged_filename == b.pre_averaged_filename
+		&& a.reference_sample_frames == b.reference_sample_frames && a.reference_sampling == b.reference_sampling
+		&& a.tile_rows == b.tile_rows;
+}
+
+std::vector<std::vector<const JobSettings *> > groupJobs(const std::vector<JobSettings> &jobs)
+{
+	std::vector<std::vector<const JobSettings *> > groups;
+	for(size_t j = 0; j < jobs.size(); ++j){
+		size_t g = 0;
+		while(g < groups.size() && !canShareFrames(*groups[g][0], jobs[j])){
+			++g;
+		}
+		if(g == groups.size()){
+			groups.push_back(std::vector<const JobSettings *>());
+		}
+		groups[g].push_back(&jobs[j]);
+	}
+	return groups;
+}
+
+//The difference functions a job uses, in the order their outputs are made.
+static std::vector<std::pair<std::string, DifferenceFunctions::FunctionId> > differenceFunctionsOf(const JobSettings &job)
+{
+	std::vector<std::pair<std::string, DifferenceFunctions::FunctionId> > functions;
+	if(job.do_regular){
+		functions.push_back(std::make_pair("Regular", DifferenceFunctions::REGULAR));
+	}
+	if(job.do_perceived_brightness){
+		functions.push_back(std::make_pair("PerceivedBrightness", DifferenceFunctions::PERCEIVED_BRIGHTNESS));
+	}
+	if(job.do_color_ratio){
+		functions.push_back(std::make_pair("ColorRatio", DifferenceFunctions::COLOR_RATIO));
+	}
+	if(job.do_inverted_color_ratio){
+		functions.push_back(std::make_pair("InvertedColorRatio", DifferenceFunctions::INVERTED_COLOR_RATIO));
+	}
+	if(job.do_half_inverted_color_ratio){
+		functions.push_back(std::make_pair("HalfInvertedColorRatio", DifferenceFunctions::HALF_INVERTED_COLOR_RATIO));
+	}
+	if(job.do_inverted_enumerator_color_ratio){
+		functions.push_back(std::make_pair("InvertedEnumeratorColorRatio", DifferenceFunctions::INVERTED_ENUMERATOR_COLOR_RATIO));
+	}
+	if(job.do_combo){
+		functions.push_back(std::make_pair("Combo", DifferenceFunctions::COMBINED));
+	}
+	if(job.do_experiment){
+		functions.push_back(std::make_pair("Experiment001", DifferenceFunctions::EXPERIMENT));
+	}
+	return functions;
+}
+
+void runJobGroup(const std::vector<const JobSettings *> &group, ThreadPool *shared_pool, WarmCache *cache)
+{
+	//How the work is done comes from the first job. (What's read is the same for all of them.)
+	const JobSettings &first = *group[0];
+	const int NUM_JOBS = group.size();
+	const bool TILED = first.tile_rows > 0;
+	const bool STREAM_MODE = first.stream_mode;
+	const bool SKIP_AVERAGING_PHASE = first.skip_averaging_phase;
+	const std::vector<std::string> &inputFilenames = first.inputFilenames;
+	const bool allow_resizing_and_cropping_to_average_shape = first.allow_resizing_and_cropping;
+	int checkpoint_interval = first.checkpoint_interval;
+	bool resume = first.resume;
+	if(NUM_JOBS > 1){
+		std::cout << "\nRunning " << NUM_JOBS << " jobs together, reading their frames once:";
+		for(int j = 0; j < NUM_JOBS; ++j){
+			std::cout << " " << group[j]->settings_filename;
+		}
+		std::cout << std::endl;
+		if(checkpoint_interval > 0 || resume){
+			std::cout << "WARNING: Checkpoints are not written or resumed when jobs are run together.\n";
+			checkpoint_interval = 0;
+			resume = false;
+		}
+	}
+	bool write_report = false, write_trace = false;
+	for(int j = 0; j < NUM_JOBS; ++j){
+		write_report = write_report || group[j]->write_report;
+		write_trace = write_trace || group[j]->write_trace;
+	}
+	//Times every phase of the run (and, with trace=true, every frame).
+	RunReport report(write_trace);
+
+	std::unique_ptr<FrameContainer> container;
+	std::unique_ptr<InputManifest> manifest;
+	if(first.container_mode){
+		container.reset(new FrameContainer(first.container_file));
+	}
+	const int NUM_IMAGES = inputFilenames.size();
+	//The input manifest goes in the same folder as the first input file, named for the output tag.
+	std::string MANIFEST_FILENAME;
+	if(first.input_manifest && !STREAM_MODE && !first.container_mode){
+		size_t last_slash = inputFilenames[0].find_last_of("/\\");
+		MANIFEST_FILENAME = ((last_slash == std::string::npos) ? std::string("") : inputFilenames[0].substr(0, last_slash + 1))
+			+ first.output_tag + ".manifest";
+	}
+	//Frames (and their dimensions) come from the container in container mode, and from the input files otherwise,
+	//skipping straight to their rasters if their headers have already been read into the manifest.
+	auto frameHeightAndWidth = [&](int x){
+		return (container) ? container->heightAndWidth(x) : (manifest) ? manifest->heightAndWidth(x) : readHeightAndWidth(inputFilenames[x]);
+	};
+	auto readFrame = [&](int x){
+		return (container) ? container->readFrame(x) : (manifest) ? readImage(inputFilenames[x], manifest->header(x)) : readImage(inputFilenames[x]);
+	};
+	//Approximate mode: the average is made from only some of the frames, to save reading all of them twice.
+	//The outputs get their own names, so they can't be mistaken for (or overwrite) the exact ones.
+	const bool APPROXIMATE = first.reference_sample_frames > 0 && first.reference_sample_frames < NUM_IMAGES && !SKIP_AVERAGING_PHASE;
+	std::vector<int> framesToAverage;
+	if(APPROXIMATE){
+		framesToAverage = sampleFrames(NUM_IMAGES, first.reference_sample_frames, first.reference_sampling == "random");
+	}
+	else{
+		for(int x = 0; x < NUM_IMAGES; ++x){
+			framesToAverage.push_back(x);
+		}
+	}
+	std::vector<std::string> outputTags;
+	for(int j = 0; j < NUM_JOBS; ++j){
+		outputTags.push_back(group[j]->output_tag + (APPROXIMATE ? "approx" : ""));
+	}
+	const std::string &output_tag = outputTags[0];
+	const std::string &OUTPUT_PATH = first.output_path;
+	const int NUM_IMAGES_TO_AVERAGE = framesToAverage.size();
+	//Every job that saves the average gets its own copy.
+	std::vector<std::string> averageFilenames; //INCLUDES PATHS
+	for(int j = 0; j < NUM_JOBS; ++j){
+		if(group[j]->save_average){
+			averageFilenames.push_back(group[j]->output_path + outputTags[j] + "avg.ppm");
+		}
+	}
+	auto saveAverage = [&](const Image &average){
+		for(size_t a = 0; a < averageFilenames.size(); ++a){
+			writeImage(average, averageFilenames[a]);
+		}
+	};
+	//Frames decoded in the averaging phase that fit in the budget are kept for the differentiating phase.
+	FrameCache frameCache((size_t) (std::max(0.0, first.frame_cache_megabytes) * 1024 * 1024), NUM_IMAGES);
+	//The pool is used for resizing frames, as well as for both phases.
+	std::unique_ptr<ThreadPool> own_pool;
+	if(shared_pool == NULL){
+		own_pool.reset(new ThreadPool(first.num_threads));
+	}
+	ThreadPool &pool = (shared_pool != NULL) ? *shared_pool : *own_pool;
+	//Every input file's header is read up front, all at once, if the output size depends on all of them
+	//(or if they're to be remembered in the manifest file).
+	if((allow_resizing_and_cropping_to_average_shape || first.input_manifest) && !STREAM_MODE && !first.container_mode){
+		report.begin(RunReport::HEADER_SCAN);
+		manifest.reset(new InputManifest(inputFilenames, MANIFEST_FILENAME, pool));
+		report.end(RunReport::HEADER_SCAN);
+		if(first.input_manifest){
+			std::cout << "Read the headers of " << manifest->headersRead() << " of " << NUM_IMAGES << " input files. (The rest were in "
+				<< MANIFEST_FILENAME << ".)" << std::endl;
+		}
+	}
+	//In tiled mode, no frame is ever read whole if it doesn't have to be, so only the first one's header is read here.
+	//In stream mode, only the stream's header is read.
+	//Images are held in ScopedImages, so that a job that fails partway through (in the job server, which carries on
+	//afterwards) doesn't leak them.
+	ScopedImage first_image;
+	std::unique_ptr<FrameStream> stream;
+	int output_height, output_width;
+	if(STREAM_MODE){
+		stream.reset(new FrameStream(first.stream_input, first.stream_format, first.stream_width, first.stream_height));
+		output_height = stream->height();
+		output_width = stream->width();
+		std::cout << "Reading a " << output_width << " by " << output_height << " stream from "
+			<< (first.stream_input == "-" ? std::string("stdin") : first.stream_input) << "." << std::endl;
+	}
+	else if(TILED){
+		std::pair<int, int> dimensions = frameHeightAndWidth(0);
+		output_height = dimensions.first;
+		output_width = dimensions.second;
+	}
+	else{
+		first_image.reset(readFrame(0));
+		output_height = first_image.get().height;
+		output_width = first_image.get().width;
+	}
+
+	if(allow_resizing_and_cropping_to_average_shape && !STREAM_MODE){
+		//0th pass: Determine the desired output size.
+		bool seen_any_mismatched_dimensions = false;
+		long long total_height = 0;
+		long long total_width = 0;
+		for(int x = 0; x < NUM_IMAGES; ++x){
+			std::pair<int, int> dimensions = frameHeightAndWidth(x);
+			total_height += dimensions.first;
+			total_width += dimensions.second;
+			if(!seen_any_mismatched_dimensions && (dimensions.first != output_height || dimensions.second != output_width)){
+				seen_any_mismatched_dimensions = true;
+			}
+		}
+		if(seen_any_mismatched_dimensions){
+			output_height = round(first.average_dimensions_multiplier * total_height / NUM_IMAGES);
+			output_width = round(first.average_dimensions_multiplier * total_width / NUM_IMAGES);
+			if(!TILED){
+				first_image.reset(resize_and_crop(first_image, output_height, output_width, false, &pool));
+			}
+
+			std::cout << "The output dimensions will be " << output_height << " by " << output_width << " pixels (" <<
+				((1.0 * output_width) / output_height) << " aspect ratio).\n";
+		}
+	}
+
+	//What frame x is called in the cache: it's the same frame (at the same size) as long as its file hasn't changed.
+	auto frameKey = [&](int x){
+		return ((container) ? WarmCache::fileStamp(first.container_file) + "#" + std::to_string(x) : WarmCache::fileStamp(inputFilenames[x]))
+			+ "|" + std::to_string(output_height) + "x" + std::to_string(output_width);
+	};
+	//The frames are only kept for later jobs if all of them (and the average) fit in the cache. Otherwise, read in
+	//order, each one would push out one that's needed sooner, and every frame would be copied in for nothing.
+	//(The average still is kept.)
+	const bool STORE_FRAMES = cache != NULL
+		&& (NUM_IMAGES + 1.0) * FrameCache::imageBytes(output_height, output_width) <= cache->budget();
+	//Reads frame x and makes sure it has the output dimensions, resizing and cropping it if that's allowed.
+	//This runs on the decoder threads of a FramePipeline.
+	FramePipeline::FrameLoader loadFrame = [&](int x){
+		RunReport::Span span(report, "decode", x);
+		std::string key;
+		if(cache != NULL){
+			key = frameKey(x);
+			Image cached;
+			if(cache->findFrame(key, &cached)){
+				return cached;
+			}
+		}
+		ScopedImage img(readFrame(x));
+		if(img.get().height != output_height || img.get().width != output_width){
+			if(allow_resizing_and_cropping_to_average_shape){
+				img.reset(resize_and_crop(img, output_height, output_width, false, &pool));
+			}
+			else {
+				//In the differentiating phase, this error could happen if the averaging phase is skipped (or if the input file is altered while the program is running).
+				std::cerr << "ERROR: Image  \"" << inputFilenames[x] << "\" dimensions do not match those of image \"" << inputFilenames[0] << "\".\n";
+				throw RunError();
+			}
+		}
+		if(STORE_FRAMES){
+			cache->storeFrame(key, img);
+		}
+		return img.release();
+	};
+
+	//Checkpoints are only resumed with the same settings for everything that goes into the average and the rankings.
+	//(The powers of score and invert_scores only matter once the rankings are done, so those can change.)
+	const std::string CHECKPOINT_FILENAME = OUTPUT_PATH + output_tag + ".checkpoint";
+	std::ostringstream checkpointSettings;
+	for(int x = 0; x < NUM_IMAGES; ++x){
+		checkpointSettings << inputFilenames[x] << "\n";
+	}
+	checkpointSettings << output_height << " " << output_width << " " << allow_resizing_and_cropping_to_average_shape << " "
+		<< SKIP_AVERAGING_PHASE << " " << first.pre_averaged_filename << "\n" << first.num_pixels_to_rank << " " << first.score_precision << " "
+		<< first.do_regular << first.do_perceived_brightness << first.do_color_ratio << first.do_inverted_color_ratio << first.do_half_inverted_color_ratio
+		<< first.do_inverted_enumerator_color_ratio << first.do_combo << first.do_experiment << "\n";
+	for(int k = 0; k < NUM_IMAGES_TO_AVERAGE; ++k){
+		checkpointSettings << framesToAverage[k] << " ";
+	}
+	const uint64_t SETTINGS_HASH = Checkpoint::hashSettings(checkpointSettings.str());
+	Checkpoint resumeFrom;
+	const bool RESUMING = resume && resumeFrom.open(CHECKPOINT_FILENAME, SETTINGS_HASH, output_height, output_width);
+	//A checkpoint is written after every checkpoint_interval frames of each phase (but not after the last one).
+	auto checkpointDue = [&](int frames_done, int frames_in_phase){
+		return checkpoint_interval > 0 && frames_done < frames_in_phase && frames_done % checkpoint_interval == 0;
+	};
+	int first_frame_to_differentiate = 0;
+	bool average_from_checkpoint = false;
+	//The same frames, averaged the same way, make the same average, so it can come from the cache.
+	std::string averageKey;
+	if(cache != NULL && !TILED && !STREAM_MODE && !SKIP_AVERAGING_PHASE && !RESUMING){
+		std::ostringstream key;
+		for(int k = 0; k < NUM_IMAGES_TO_AVERAGE; ++k){
+			key << frameKey(framesToAverage[k]) << "\n";
+		}
+		averageKey = key.str();
+	}
+	Image cachedAverage = Image();
+	const bool CACHED_AVERAGE = !averageKey.empty() && cache->findAverage(averageKey, &cachedAverage);
+
+	std::cout << "\nUsing " << pool.size() << " thread(s) and "
+		<< DifferenceFunctions::instructionSetName(DifferenceFunctions::bestInstructionSet()) << " difference functions." << std::endl;
+
+	//First pass: Sum all the values in the input files.
+	//(In tiled mode, this is done a strip at a time, by processInStrips.)
+	ScopedImage meanAverageImage;
+	if(!TILED){
+		report.begin(RunReport::AVERAGING);
+	}
+
+	if(TILED){
+		std::cout << "\nTiled mode: Processing " << first.tile_rows << " rows at a time." << std::endl;
+	}
+	else if(RESUMING && resumeFrom.phase() == Checkpoint::DIFFERENTIATING){
+		first_frame_to_differentiate = resumeFrom.framesDone();
+		std::cout << "\nRESUMING FROM CHECKPOINT. Skipping averaging phase and the first " << first_frame_to_differentiate
+			<< " frame(s) of the differentiating phase." << std::endl;
+		meanAverageImage.reset(resumeFrom.readAverage());
+		average_from_checkpoint = true;
+		first_image.reset();
+		//A checkpoint from right after the averaging phase has no rankings worth reading.
+		if(first_frame_to_differentiate == 0){
+			resumeFrom.close();
+		}
+	}
+	else if(SKIP_AVERAGING_PHASE){
+		std::cout << "\nSKIPPING AVERAGING PHASE. Reading in pre-averaged file." << std::endl;
+		meanAverageImage.reset(readImage(first.pre_averaged_filename));
+		first_image.reset();
+
+		if(meanAverageImage.get().height != output_height || meanAverageImage.get().width != output_width){
+			std::cerr << "ERROR: Pre-averaged image dimensions do not match expected output dimensions.\n";
+			throw RunError();
+		}
+	}
+	else if(CACHED_AVERAGE){
+		std::cout << "\nSKIPPING AVERAGING PHASE. These frames were already averaged for an earlier job." << std::endl;
+		meanAverageImage.reset(cachedAverage);
+		first_image.reset();
+		saveAverage(meanAverageImage);
+	}
+	else if(STREAM_MODE){
+		//The stream can only be read once, so it is copied to the spool file as it is averaged, and the differentiating
+		//phase reads that instead.
+		std::cout << "\nBeginning averaging phase. Spooling the stream to " << first.stream_spool_path << "." << std::endl;
+		AverageAccumulator totals(output_height, output_width);
+		stream->spoolTo(first.stream_spool_path + output_tag + ".spool");
+		Image img;
+		while(stream->next(&img, pool)){
+			ScopedImage frame(img); //Deleted at the end of each pass through the loop, even if there's an error.
+			{
+				RunReport::Span span(report, "average", stream->framesRead() - 1);
+				totals.add(img, pool);
+			}
+			report.addPixels(RunReport::AVERAGING, (double) output_height * output_width);
+			std::cout << "Averaging: Processed image #" << stream->framesRead() << " of the stream" << std::endl;
+		}
+		if(stream->framesRead() == 0){
+			std::cerr << "ERROR: No frames found in the stream.\n";
+			throw RunError();
+		}
+		meanAverageImage.reset(totals.mean(stream->framesRead(), pool));
+		stream.reset(new FrameStream(first.stream_spool_path + output_tag + ".spool", first.stream_format, output_width, output_height));
+		saveAverage(meanAverageImage);
+	}
+	else{
+		std::cout << "\nBeginning averaging phase. First image should take the longest." << std::endl;
+		if(APPROXIMATE){
+			std::cout << "APPROXIMATE MODE. Averaging " << NUM_IMAGES_TO_AVERAGE << " of " << NUM_IMAGES << " frames ("
+				<< first.reference_sampling << " sample)." << std::endl;
+		}
+		AverageAccumulator totals(output_height, output_width);
+		int frames_averaged = 0; //of framesToAverage
+
+		if(RESUMING){
+			frames_averaged = resumeFrom.framesDone();
+			std::cout << "RESUMING FROM CHECKPOINT. Skipping the first " << frames_averaged << " frame(s) of the averaging phase." << std::endl;
+			resumeFrom.readTotals(totals.wideTotals());
+			resumeFrom.close();
+			first_image.reset();
+		}
+		else if(framesToAverage[0] == 0){
+			//First image
+			{
+				RunReport::Span span(report, "average", 0);
+				totals.add(first_image, pool);
+			}
+			report.addPixels(RunReport::AVERAGING, (double) output_height * output_width);
+			if(frameCache.store(0, first_image)){
+				first_image.release();
+			}
+			else{
+				first_image.reset();
+			}
+			std::cout << "Averaging: Processed 1st image ok" << std::endl;
+			frames_averaged = 1;  //starting with the second image because we already did the first as a special case
+		}
+		else{
+			//A random sample can leave out the first image, which has already been read, so it is kept for later if it fits.
+			if(frameCache.store(0, first_image)){
+				first_image.release();
+			}
+			else{
+				first_image.reset();
+			}
+		}
+		std::vector<int> remainingFrames(framesToAverage.begin() + frames_averaged, framesToAverage.end());
+		FramePipeline averagingPipeline(remainingFrames, loadFrame, first.decoder_threads, first.prefetch_depth);
+		while(!averagingPipeline.done()){
+			int x;
+			ScopedImage img(averagingPipeline.next(&x));
+
+			{
+				RunReport::Span span(report, "average", x);
+				totals.add(img, pool);
+			}
+			report.addPixels(RunReport::AVERAGING, (double) output_height * output_width);
+			if(frameCache.store(x, img)){
+				img.release();
+			}
+			++frames_averaged;
+			std::cout << "Averaging: Processed image #" << x + 1 << " of " << NUM_IMAGES << std::endl;
+			if(checkpointDue(frames_averaged, NUM_IMAGES_TO_AVERAGE)
+				&& Checkpoint::writeAveraging(CHECKPOINT_FILENAME, SETTINGS_HASH, frames_averaged, output_height, output_width, totals.wideTotals())){
+				std::cout << "Wrote checkpoint after averaging image #" << x + 1 << std::endl;
+			}
+		}
+		meanAverageImage.reset(totals.mean(NUM_IMAGES_TO_AVERAGE, pool));
+		saveAverage(meanAverageImage);
+		if(!averageKey.empty()){
+			cache->storeAverage(averageKey, meanAverageImage);
+		}
+	}
+	if(!TILED){
+		report.end(RunReport::AVERAGING);
+	}
+
+	//Every job's difference records go in drs, for one differentiating pass. A record that's exactly the same as
+	//one an earlier job already has (the same function, number of rankings, precision, and invert_scores) is shared.
+	std::vector<DifferenceRecord> drs;
+	std::vector<std::vector<size_t> > jobRecords(NUM_JOBS); //Indexes into drs, for each job.
+	bool printed_experiment = false;
+	for(int j = 0; j < NUM_JOBS; ++j){
+		const JobSettings &job = *group[j];
+		std::vector<std::pair<std::string, DifferenceFunctions::FunctionId> > functions = differenceFunctionsOf(job);
+		for(size_t f = 0; f < functions.size(); ++f){
+			if(functions[f].second == DifferenceFunctions::EXPERIMENT && !printed_experiment){
+				std::cout << "Including the Experiment Difference Function : " << DifferenceFunctions::NAME_OF_CURRENT_EXPERIMENT_DIFFERENCE_FUNCTION << "\n";
+				printed_experiment = true;
+			}
+			size_t drs_index = 0;
+			while(drs_index < drs.size() && !(drs[drs_index].function_id == functions[f].second
+				&& drs[drs_index].num_pixels_to_rank == (unsigned int) job.num_pixels_to_rank
+				&& drs[drs_index].score_precision == job.score_precision && drs[drs_index].invert_scores == job.invert_scores)){
+				++drs_index;
+			}
+			if(drs_index == drs.size()){
+				DifferenceRecord dr;
+				dr.name = functions[f].first;
+				dr.function_id = functions[f].second;
+				dr.num_pixels_to_rank = job.num_pixels_to_rank;
+				dr.invert_scores = job.invert_scores;
+				dr.score_powers = job.powers_of_score;
+				dr.rankings_to_save = job.rankings_to_save;
+				dr.score_precision = job.score_precision;
+				drs.push_back(std::move(dr));
+			}
+			jobRecords[j].push_back(drs_index);
+		}
+	}
+	if(NUM_JOBS > 1){
+		std::cout << "The " << NUM_JOBS << " jobs use " << drs.size() << " difference record(s) in all." << std::endl;
+	}
+
+	//Initialize the rankings (all colors white, all scores zero). In tiled mode, this is done for each strip.
+	for(size_t drs_index = 0; drs_index < drs.size(); ++drs_index){
+		if(!TILED){
+			allocateRankings(drs[drs_index], output_height, output_width);
+		}
+	}
+	if(first_frame_to_differentiate > 0){
+		resumeFrom.readRankings(drs);
+		resumeFrom.close();
+	}
+
+	//All of the difference functions in use are computed together, in one pass over each row.
+	unsigned int function_set = 0;
+	for(size_t drs_index = 0; drs_index < drs.size(); ++drs_index){
+		function_set |= 1u << drs[drs_index].function_id;
+	}
+	DifferenceFunctions::FusedRowFunction scoreRow = DifferenceFunctions::fusedRowFunction(function_set);
+
+	//Every combination of difference function, number of rankings, and power of score is its own output image,
+	//for each job.
+	std::vector<OutputJob> outputJobs;
+	for(int j = 0; j < NUM_JOBS; ++j){
+		const JobSettings &job = *group[j];
+		bool use_tag_as_entire_filename = false;
+		if(job.list_mode && jobRecords[j].size() == 1 && job.rankings_to_save.size() == 1 && job.powers_of_score.size() == 1){
+			use_tag_as_entire_filename = true;
+		}
+		for(size_t r = 0; r < jobRecords[j].size(); ++r){
+			const DifferenceRecord &dr = drs[jobRecords[j][r]];
+			for(size_t ranking_index = 0; ranking_index < job.rankings_to_save.size(); ++ranking_index){
+				int num_pixels_to_rank_this_round = job.rankings_to_save[ranking_index];
+				int num_powers_this_round = job.powers_of_score.size();
+				if(num_pixels_to_rank_this_round == 1){
+					num_powers_this_round = 1;
+				}
+				for(int sp_index = 0; sp_index < num_powers_this_round; ++sp_index){
+					double current_power = job.powers_of_score[sp_index];
+					if(num_pixels_to_rank_this_round == 1){
+						current_power = 1.0;
+					}
+					OutputJob outputJob;
+					outputJob.dr = &dr;
+					outputJob.num_rankings = num_pixels_to_rank_this_round;
+					outputJob.power = current_power;
+					outputJob.path = job.output_path;
+					//The filename DOES NOT INCLUDE PATH
+					if(use_tag_as_entire_filename){
+						outputJob.filename = outputTags[j] + ".ppm";
+					}
+					else{
+						outputJob.filename = outputTags[j] + dr.name
+													+ "_rank" + Utility::intToString(num_pixels_to_rank_this_round)
+													+ "_power" + Utility::doubleToString(current_power, 3);
+						if(dr.invert_scores){
+							outputJob.filename += "_invertscore";
+						}
+						outputJob.filename += ".ppm";
+					}
+					outputJobs.push_back(outputJob);
+				}
+			}
+		}
+	}
+
+	//Second pass: Find the most different.
+	if(TILED){
+		TiledSettings tiled;
+		tiled.inputFilenames = inputFilenames;
+		tiled.container = container.get();
+		tiled.manifest = manifest.get();
+		tiled.output_height = output_height;
+		tiled.output_width = output_width;
+		tiled.strip_rows = first.tile_rows;
+		tiled.allow_resizing_and_cropping = allow_resizing_and_cropping_to_average_shape;
+		tiled.loadWholeFrame = loadFrame;
+		tiled.decoder_threads = first.decoder_threads;
+		tiled.prefetch_depth = first.prefetch_depth;
+		tiled.skip_averaging_phase = SKIP_AVERAGING_PHASE;
+		tiled.framesToAverage = framesToAverage;
+		tiled.pre_averaged_filename = first.pre_averaged_filename;
+		tiled.average_filenames = averageFilenames;
+		tiled.report = &report;
+		processInStrips(tiled, drs, scoreRow, outputJobs, pool);
+	}
+	else{
+		std::cout << "\nBeginning differentiating phase. First image should take the longest." << std::endl;
+		report.begin(RunReport::DIFFERENTIATING);
+		//For the report, one frame is kept, to measure each difference function on after the run.
+		ScopedImage measuringFrame;
+		auto keepForMeasuring = [&](const Image &img){
+			if(write_report && !measuringFrame.held()){
+				measuringFrame.reset(createImageUninitialized(img.height, img.width));
+				memcpy(measuringFrame.get().data, img.data, sizeof(Pixel) * (size_t) img.height * img.width);
+			}
+		};
+		//Once the average is done, it is checkpointed too, so it doesn't have to be done again.
+		//(Unless it came from that very checkpoint.)
+		if(checkpoint_interval > 0 && first_frame_to_differentiate == 0 && !SKIP_AVERAGING_PHASE && !average_from_checkpoint
+			&& Checkpoint::writeDifferentiating(CHECKPOINT_FILENAME, SETTINGS_HASH, 0, meanAverageImage, drs)){
+			std::cout << "Wrote checkpoint after averaging phase" << std::endl;
+		}
+		if(frameCache.framesHeld() > 0){
+			std::cout << frameCache.framesHeld() << " of " << NUM_IMAGES << " frames are cached in memory ("
+				<< (frameCache.bytesUsed() / (1024 * 1024)) << " MB)." << std::endl;
+		}
+		if(STREAM_MODE){
+			//From the spool file, or, if the averaging phase was skipped, straight from the stream, in one pass.
+			//(There are no input files in stream mode, so the loop over them below has nothing to do.)
+			Image img;
+			while(stream->next(&img, pool)){
+				ScopedImage frame(img);
+				const int x = stream->framesRead() - 1;
+				{
+					RunReport::Span span(report, "rank", x);
+					pool.parallelForBands(0, output_height, [&](int first_row, int last_row){
+						rankFrameRows(drs, scoreRow, meanAverageImage, img, first_row, last_row, x);
+					});
+				}
+				report.addPixels(RunReport::DIFFERENTIATING, (double) output_height * output_width);
+				keepForMeasuring(img);
+				std::cout << "Differentiating: Processed image #" << x + 1 << " of the stream" << std::endl;
+			}
+			stream.reset();
+			if(!SKIP_AVERAGING_PHASE){
+				remove((first.stream_spool_path + output_tag + ".spool").c_str());
+			}
+		}
+		//Only the frames that aren't already in memory need to go through the pipeline.
+		std::vector<int> uncachedFrames;
+		for(int x = first_frame_to_differentiate; x < NUM_IMAGES; ++x){
+			if(!frameCache.has(x)){
+				uncachedFrames.push_back(x);
+			}
+		}
+		FramePipeline differentiatingPipeline(uncachedFrames, loadFrame, first.decoder_threads, first.prefetch_depth);
+		//In approximate mode, every frame still goes by here, so the exact average can be worked out for a sample of pixels
+		//along the way, to see how good the approximation was. (Not when resuming, since the frames before the checkpoint are gone.)
+		const bool MEASURE_APPROXIMATION = APPROXIMATE && first_frame_to_differentiate == 0;
+		AverageErrorSampler approximationError(MEASURE_APPROXIMATION ? output_height : 0, MEASURE_APPROXIMATION ? output_width : 0);
+		for(int x = first_frame_to_differentiate; x < NUM_IMAGES; ++x){
+			ScopedImage img;
+			Image cached;
+			if(frameCache.take(x, &cached)){
+				img.reset(cached);
+			}
+			else{
+				int pipeline_x;
+				img.reset(differentiatingPipeline.next(&pipeline_x));
+			}
+			//Every pixel's rankings are independent of every other pixel's, so the rows can be split into bands
+			//and handed to separate threads. Frames are still processed one at a time, in order, so the results
+			//are identical to a single-threaded run.
+			{
+				RunReport::Span span(report, "rank", x);
+				pool.parallelForBands(0, output_height, [&](int first_row, int last_row){
+					rankFrameRows(drs, scoreRow, meanAverageImage, img, first_row, last_row, x);
+				});
+			}
+			report.addPixels(RunReport::DIFFERENTIATING, (double) output_height * output_width);
+			keepForMeasuring(img);
+			if(MEASURE_APPROXIMATION){
+				approximationError.add(img);
+			}
+			img.reset();
+			std::cout << "Differentiating: Processed image #" << x + 1 << " of " << NUM_IMAGES << std::endl;
+			if(checkpointDue(x + 1, NUM_IMAGES) && Checkpoint::writeDifferentiating(CHECKPOINT_FILENAME, SETTINGS_HASH, x + 1, meanAverageImage, drs)){
+				std::cout << "Wrote checkpoint after differentiating image #" << x + 1 << std::endl;
+			}
+		}
+
+		//Put every pixel's rankings in order, once, before they are used.
+		pool.parallelForBands(0, output_height, [&](int first_row, int last_row){
+			for(size_t drs_index = 0; drs_index < drs.size(); ++drs_index){
+				drs[drs_index].rankings.finish(first_row, last_row);
+			}
+		});
+		report.end(RunReport::DIFFERENTIATING);
+
+		if(MEASURE_APPROXIMATION){
+			approximationError.report(meanAverageImage, NUM_IMAGES);
+		}
+
+		std::cout << "\nBeginning output file creation phase." << std::endl;
+
+		//The images are rendered in parallel and written out in the order above.
+		report.begin(RunReport::OUTPUT);
+		renderAndWriteOutputs(outputJobs, meanAverageImage, pool);
+		report.addPixels(RunReport::OUTPUT, (double) outputJobs.size() * output_height * output_width);
+		report.end(RunReport::OUTPUT);
+
+		//The run computes all the difference functions together, so to see what each one costs, they're each timed
+		//separately (and together) on the frame that was kept.
+		if(measuringFrame.held()){
+			std::vector<double> scores((size_t) DifferenceFunctions::NUM_FUNCTIONS * output_width);
+			unsigned int measured = 0;
+			for(size_t drs_index = 0; drs_index < drs.size(); ++drs_index){
+				if(measured & (1u << drs[drs_index].function_id)){
+					continue;
+				}
+				measured |= 1u << drs[drs_index].function_id;
+				DifferenceFunctions::RowFunction row = DifferenceFunctions::rowFunction(drs[drs_index].function_id);
+				report.measureFunction(drs[drs_index].name, output_height, output_width, [&](int i){
+					row(meanAverageImage.get().map[i], measuringFrame.get().map[i], &scores[0], output_width);
+				});
+			}
+			double *fusedScores[DifferenceFunctions::NUM_FUNCTIONS];
+			for(int id = 0; id < DifferenceFunctions::NUM_FUNCTIONS; ++id){
+				fusedScores[id] = &scores[(size_t) id * output_width];
+			}
+			report.measureFunction("all_together", output_height, output_width, [&](int i){
+				scoreRow(meanAverageImage.get().map[i], measuringFrame.get().map[i], fusedScores, output_width);
+			});
+			measuringFrame.reset();
+		}
+		meanAverageImage.reset();
+
+		//The run is done, so there's nothing left to resume.
+		if((checkpoint_interval > 0 || RESUMING) && remove(CHECKPOINT_FILENAME.c_str()) == 0){
+			std::cout << "Removed checkpoint file " << CHECKPOINT_FILENAME << std::endl;
+		}
+	}
+
+	//Each job that asked for the report (or the timeline) gets a copy, under its own tag.
+	for(int j = 0; j < NUM_JOBS; ++j){
+		if(group[j]->write_report){
+			const std::string REPORT_FILENAME = group[j]->output_path + outputTags[j] + "report.json";
+			if(report.write(REPORT_FILENAME, outputTags[j], output_height, output_width, NUM_IMAGES, pool.size(),
+				DifferenceFunctions::instructionSetName(DifferenceFunctions::bestInstructionSet()))){
+				std::cout << "Wrote report " << REPORT_FILENAME << std::endl;
+			}
+			else{
+				std::cout << "WARNING: Couldn't write report " << REPORT_FILENAME << std::endl;
+			}
+		}
+		if(group[j]->write_trace){
+			const std::string TRACE_FILENAME = group[j]->output_path + outputTags[j] + "trace.json";
+			if(report.writeTrace(TRACE_FILENAME)){
+				std::cout << "Wrote timeline " << TRACE_FILENAME << std::endl;
+			}
+			else{
+				std::cout << "WARNING: Couldn't write timeline " << TRACE_FILENAME << std::endl;
+			}
+		}
+	}
+}
+
+int runJobGroups(const std::vector<std::vector<const JobSettings *> > &groups, ThreadPool *shared_pool, WarmCache *cache)
+{
+	int failed = 0;
+	for(size_t g = 0; g < groups.size(); ++g){
+		try{
+			runJobGroup(groups[g], shared_pool, cache);
+		} catch(const RunError &){
+			++failed;
+			std::cerr << "ERROR: Could not finish the job(s) from";
+			for(size_t j = 0; j < groups[g].size(); ++j){
+				std::cerr << " " << groups[g][j]->settings_filename;
+			}
+			std::cerr << "\n";
+			if(g + 1 < groups.size()){
+				std::cerr << "Carrying on with the other jobs.\n";
+			}
+		}
+	}
+	return failed;
+}
@@ -0,0 +1,40 @@
+// LeastAverageImage
+// Andrew Eckel
+// jobrunner.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef JOBRUNNER_H
+#define JOBRUNNER_H
+
+#include <vector>
+
+#include "jobsettings.h"
+#include "threadpool.h"
+#include "warmcache.h"
+
+//Whether two jobs read the very same frames the same way, to the same average, so they can be run together.
+//Everything else, like the difference functions, the rankings, and where the outputs go, can differ.
+//Stream mode jobs are always run by themselves, since a stream can only be read once.
+bool canShareFrames(const JobSettings &a, const JobSettings &b);
+
+//Sort jobs into groups that can share their frames (in the order each group's first job appears).
+std::vector<std::vector<const JobSettings *> > groupJobs(const std::vector<JobSettings> &jobs);
+
+//Run a group of jobs together: the frames are read, and averaged, once, and one differentiating pass ranks them with
+//every job's difference records at once. (Records that are exactly the same in two jobs are shared.) Then each job's
+//outputs are written, with its own output_tag, to its own output_path.
+//Settings that only affect how the work is done, like threads, frame_cache_megabytes, and decoder_threads, come from the
+//first job. Checkpoints are only written and resumed for a group of one job.
+//A process that runs one group after another (like the job server) can pass in its own pool, which is then used
+//instead of one with the first job's number of threads, and a cache, where averages and decoded frames are looked
+//for before they're made, and kept afterwards.
+//Throws RunError if anything goes wrong (after printing what).
+void runJobGroup(const std::vector<const JobSettings *> &group, ThreadPool *shared_pool = NULL, WarmCache *cache = NULL);
+
+//Run each group in turn with runJobGroup. A group that fails doesn't stop the ones after it: its error is printed, and
+//the next group is run. Returns the number of groups that failed.
+int runJobGroups(const std::vector<std::vector<const JobSettings *> > &groups, ThreadPool *shared_pool = NULL, WarmCache *cache = NULL);
+
+#endif //JOBRUNNER_H
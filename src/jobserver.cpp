@@ -0,0 +1,739 @@
+// LeastAverageImage
+// Andrew Eckel
+// jobserver.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#include "jobserver.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+
+int serveJobs(const std::string &socket_filename, int job_workers, double cache_megabytes, int threads)
+{
+	std::cerr << "ERROR: The job server needs UNIX domain sockets, which this build doesn't have.\n";
+	return 1;
+}
+
+int submitJobs(const std::string &socket_filename, const std::vector<std::string> &settings_filenames)
+{
+	std::cerr << "ERROR: The job server needs UNIX domain sockets, which this build doesn't have.\n";
+	return 1;
+}
+
+int stopJobServer(const std::string &socket_filename)
+{
+	std::cerr << "ERROR: The job server needs UNIX domain sockets, which this build doesn't have.\n";
+	return 1;
+}
+
+#else
+
+#include <fstream>
+#include <sstream>
+#include <streambuf>
+#include <deque>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "jobsettings.h"
+#include "jobrunner.h"
+#include "threadpool.h"
+#include "warmcache.h"
+#include "utility.h"
+#include "ppm_functions.h"
+
+//Write all of s to fd. Returns false if the other end has gone away.
+static bool sendAll(int fd, const std::string &s)
+{
+	size_t sent = 0;
+	while(sent < s.size()){
+		ssize_t n = write(fd, s.data() + sent, s.size() - sent);
+		if(n < 0 && errno == EINTR){
+			continue;
+		}
+		if(n <= 0){
+			return false;
+		}
+		sent += n;
+	}
+	return true;
+}
+
+//Reads a connection a line (or a given number of bytes) at a time.
+class LineReader
+{
+public:
+	//Lines longer than this are refused, rather than buffered without end.
+	static const size_t MAX_LINE_LENGTH = 64 * 1024;
+
+	//If seconds isn't 0, reading stops once that many seconds have gone by.
+	explicit LineReader(int fd, int seconds = 0) : fd(fd), timed(seconds > 0),
+		deadline(std::chrono::steady_clock::now() + std::chrono::seconds(seconds)) {}
+
+	//The next line, without its line ending. Returns false at the end of the connection, or if something's wrong
+	//(see problem()).
+	bool readLine(std::string *line)
+	{
+		size_t newline;
+		while((newline = buffered.find('\n')) == std::string::npos){
+			if(buffered.size() > MAX_LINE_LENGTH){
+				whats_wrong = "A line was longer than " + std::to_string(MAX_LINE_LENGTH) + " bytes.";
+				return false;
+			}
+			if(!fill()){
+				return false;
+			}
+		}
+		*line = buffered.substr(0, newline);
+		buffered.erase(0, newline + 1);
+		if(!line->empty() && (*line)[line->size() - 1] == '\r'){
+			line->erase(line->size() - 1);
+		}
+		return true;
+	}
+
+	bool readBytes(size_t length, std::string *bytes)
+	{
+		while(buffered.size() < length){
+			if(!fill()){
+				return false;
+			}
+		}
+		*bytes = buffered.substr(0, length);
+		buffered.erase(0, length);
+		return true;
+	}
+
+	//Why reading stopped early, or empty if it didn't (or if the connection just ended).
+	const std::string &problem() const
+	{
+		return whats_wrong;
+	}
+
+private:
+	bool fill()
+	{
+		if(timed && std::chrono::steady_clock::now() > deadline){
+			whats_wrong = "The request took too long to arrive.";
+			return false;
+		}
+		char chunk[4096];
+		ssize_t n;
+		do{
+			n = read(fd, chunk, sizeof(chunk));
+		} while(n < 0 && errno == EINTR);
+		if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+			whats_wrong = "The request took too long to arrive.";
+		}
+		if(n <= 0){
+			return false;
+		}
+		buffered.append(chunk, n);
+		return true;
+	}
+
+	int fd;
+	bool timed;
+	std::chrono::steady_clock::time_point deadline;
+	std::string buffered;
+	std::string whats_wrong;
+};
+
+//The client of a job that's running.
+typedef struct
+{
+	int fd;
+	bool connected;
+	std::string pending[2]; //What's been printed to std::cout and std::cerr since their last line ending.
+	std::mutex mutex;
+} JobClient;
+//The client of the job that's running on this thread, if there is one.
+static thread_local JobClient *current_client = NULL;
+//The clients of every job that's running. Held while anything is sent to one of them from another thread.
+static std::mutex running_mutex;
+static std::vector<JobClient *> running_clients;
+
+//While the server runs, std::cout and std::cerr write to one of these each. What a job's own thread prints is sent
+//to that job's client, a line at a time, after the given prefix. So is what any other thread (like a decoder thread,
+//or one of the pool's) prints while that's the only job running, since it's almost certainly for that job.
+//Anything else, like the server's own messages, goes where it always did.
+class ClientStreamBuf : public std::streambuf
+{
+public:
+	ClientStreamBuf(std::streambuf *original, int stream, const std::string &prefix)
+		: original(original), stream(stream), prefix(prefix) {}
+
+	//Send whatever this thread's job has left after its last line ending.
+	void finishLine()
+	{
+		if(current_client != NULL){
+			std::lock_guard<std::mutex> lock(current_client->mutex);
+			if(!current_client->pending[stream].empty()){
+				send(current_client, "\n", 1);
+			}
+		}
+	}
+
+protected:
+	int overflow(int c)
+	{
+		if(c == EOF){
+			return traits_type::not_eof(c);
+		}
+		char ch = (char) c;
+		return (xsputn(&ch, 1) == 1) ? c : EOF;
+	}
+
+	std::streamsize xsputn(const char *s, std::streamsize n)
+	{
+		if(current_client != NULL){
+			std::lock_guard<std::mutex> lock(current_client->mutex);
+			send(current_client, s, n);
+			return n;
+		}
+		std::unique_lock<std::mutex> running_lock(running_mutex);
+		if(running_clients.size() == 1){
+			std::lock_guard<std::mutex> lock(running_clients[0]->mutex);
+			send(running_clients[0], s, n);
+			return n;
+		}
+		running_lock.unlock();
+		return original->sputn(s, n);
+	}
+
+	int sync()
+	{
+		return (current_client == NULL) ? original->pubsync() : 0;
+	}
+
+private:
+	//Send every whole line to the client. The caller holds the client's mutex.
+	void send(JobClient *client, const char *s, std::streamsize n)
+	{
+		std::string &pending = client->pending[stream];
+		pending.append(s, n);
+		size_t newline;
+		while((newline = pending.find('\n')) != std::string::npos){
+			if(client->connected){
+				client->connected = sendAll(client->fd, prefix + pending.substr(0, newline + 1));
+			}
+			pending.erase(0, newline + 1);
+		}
+	}
+
+	std::streambuf *original;
+	int stream;
+	std::string prefix;
+};
+
+static bool validSettingsName(const std::string &name)
+{
+	return !name.empty() && name != "." && name != ".." && name.find_first_of("/\\") == std::string::npos;
+}
+
+//A request to run some settings files, waiting for a job worker.
+typedef struct
+{
+	int fd;
+	int job_number;
+	std::vector<std::string> settings_filenames;
+	std::vector<std::string> spooled; //Settings files that were sent in, to be removed afterwards.
+	std::string spool_folder;
+} JobRequest;
+
+//Everything the server's threads share.
+typedef struct
+{
+	std::string socket_filename;
+	ThreadPool *pool;
+	WarmCache *cache;
+	ClientStreamBuf *out, *err;
+	std::ostream *log; //The server's own messages, which aren't for any client.
+	std::deque<JobRequest> waiting;
+	std::set<std::string> files_in_use; //See FilesInUse.
+	std::mutex mutex;
+	std::condition_variable cv;
+	int reading; //Requests still being read.
+	std::atomic<bool> stopping;
+} ServerState;
+
+//Jobs that write the same files (the same outputs and checkpoint, or the same input manifest) can't run at the same
+//time, or they'd overwrite each other's. So while a request runs, its jobs' files are marked as in use, and a request
+//that needs any of them waits until they're free.
+class FilesInUse
+{
+public:
+	FilesInUse(ServerState &server, const std::vector<JobSettings> &jobs) : server(server)
+	{
+		for(size_t j = 0; j < jobs.size(); ++j){
+			const std::string &first_input = jobs[j].inputFilenames.empty() ? std::string() : jobs[j].inputFilenames[0];
+			const size_t LAST_SLASH = first_input.find_last_of("/\\");
+			files.insert(jobs[j].output_path + jobs[j].output_tag);
+			files.insert(((LAST_SLASH == std::string::npos) ? std::string() : first_input.substr(0, LAST_SLASH + 1))
+				+ jobs[j].output_tag + ".manifest");
+		}
+		std::unique_lock<std::mutex> lock(server.mutex);
+		if(!available()){
+			std::cout << "Waiting for another job that writes the same files to finish." << std::endl;
+			server.cv.wait(lock, [this]() { return available(); });
+		}
+		server.files_in_use.insert(files.begin(), files.end());
+	}
+
+	~FilesInUse()
+	{
+		{
+			std::lock_guard<std::mutex> lock(server.mutex);
+			for(std::set<std::string>::const_iterator f = files.begin(); f != files.end(); ++f){
+				server.files_in_use.erase(*f);
+			}
+		}
+		server.cv.notify_all();
+	}
+
+private:
+	//The caller holds server.mutex.
+	bool available() const
+	{
+		for(std::set<std::string>::const_iterator f = files.begin(); f != files.end(); ++f){
+			if(server.files_in_use.count(*f) > 0){
+				return false;
+			}
+		}
+		return true;
+	}
+
+	ServerState &server;
+	std::set<std::string> files;
+};
+
+//Settings files are a few kilobytes, so anything much bigger is a mistake (or worse).
+static const long long MAX_SETTINGS_LENGTH = 1024 * 1024;
+//How long a client gets to send its whole request, and how long it can go without taking what it's sent.
+static const int REQUEST_SECONDS = 10;
+static const int SEND_SECONDS = 60;
+//How many requests can be read at once. Any more are turned away.
+static const int MAX_READING = 16;
+
+static void removeSpooled(const JobRequest &request)
+{
+	for(size_t s = 0; s < request.spooled.size(); ++s){
+		remove(request.spooled[s].c_str());
+	}
+	if(!request.spooled.empty()){
+		rmdir(request.spool_folder.c_str());
+	}
+}
+
+//Read one request from request.fd, saving any settings files that were sent in. Sets *shutdown if the server was
+//asked to stop. Returns what's wrong with the request, if anything.
+static std::string readRequest(const std::string &socket_filename, JobRequest &request, bool *shutdown)
+{
+	LineReader reader(request.fd, REQUEST_SECONDS);
+	request.spool_folder = socket_filename + ".jobs/" + std::to_string(request.job_number);
+	bool run = false;
+	*shutdown = false;
+	std::string line, problem;
+	while(!run && !*shutdown && problem.empty() && reader.readLine(&line)){
+		if(line.compare(0, 5, "file ") == 0){
+			request.settings_filenames.push_back(line.substr(5));
+		}
+		else if(line.compare(0, 9, "settings ") == 0){
+			std::istringstream fields(line.substr(9));
+			std::string name, contents;
+			long long length = -1;
+			fields >> name >> length;
+			if(!validSettingsName(name) || length < 0){
+				problem = "Invalid settings request: " + line;
+			}
+			else if(length > MAX_SETTINGS_LENGTH){
+				problem = name + " is " + std::to_string(length) + " bytes, but settings can be at most "
+					+ std::to_string(MAX_SETTINGS_LENGTH) + ".";
+			}
+			else if(!reader.readBytes((size_t) length, &contents)){
+				problem = reader.problem().empty() ? "The connection ended in the middle of " + name : reader.problem();
+			}
+			else{
+				if(request.spooled.empty()){
+					mkdir((socket_filename + ".jobs").c_str(), 0700);
+					mkdir(request.spool_folder.c_str(), 0700);
+				}
+				const std::string FILENAME = request.spool_folder + "/" + name;
+				std::ofstream file(FILENAME.c_str(), std::ios::binary);
+				file << contents;
+				if(!file){
+					problem = "Couldn't save " + FILENAME;
+				}
+				request.spooled.push_back(FILENAME);
+				request.settings_filenames.push_back(FILENAME);
+			}
+		}
+		else if(line == "run"){
+			run = true;
+		}
+		else if(line == "shutdown"){
+			*shutdown = true;
+		}
+		else if(!line.empty()){
+			problem = "Unknown request: " + line;
+		}
+	}
+	if(problem.empty()){
+		problem = reader.problem();
+	}
+	//A request that just stops after its settings files means to run them.
+	if(problem.empty() && !*shutdown && request.settings_filenames.empty()){
+		problem = "No settings files were sent.";
+	}
+	return problem;
+}
+
+//Run the settings files of a request, sending everything the job prints to its client.
+static void runRequest(ServerState &server, const JobRequest &request)
+{
+	const int FD = request.fd;
+	*server.log << "Job " << request.job_number << ": Started, with " << request.settings_filenames.size()
+		<< " settings file(s)." << std::endl;
+	std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+	JobClient client;
+	client.fd = FD;
+	client.connected = true;
+	bool succeeded = false;
+	current_client = &client;
+	//What this job reads and writes is counted apart from any other job that's running.
+	ByteTotals job_bytes;
+	countBytesInto(&job_bytes);
+	try{
+		std::vector<JobSettings> jobs;
+		for(size_t f = 0; f < request.settings_filenames.size(); ++f){
+			jobs.push_back(readJobSettings(request.settings_filenames[f]));
+		}
+		std::vector<std::vector<const JobSettings *> > groups = groupJobs(jobs);
+		FilesInUse files(server, jobs);
+		{
+			std::lock_guard<std::mutex> lock(running_mutex);
+			running_clients.push_back(&client);
+		}
+		succeeded = runJobGroups(groups, server.pool, server.cache) == 0;
+	} catch(const RunError &){
+		//The error has already been printed, to the client.
+	} catch(const std::exception &e){
+		std::cerr << "ERROR: " << e.what() << "\n";
+	}
+	{
+		std::lock_guard<std::mutex> lock(running_mutex);
+		std::vector<JobClient *>::iterator running = std::find(running_clients.begin(), running_clients.end(), &client);
+		if(running != running_clients.end()){
+			running_clients.erase(running);
+		}
+	}
+	server.out->finishLine();
+	server.err->finishLine();
+	current_client = NULL;
+	countBytesInto(NULL);
+	if(client.connected){
+		sendAll(FD, succeeded ? "done\n" : "failed\n");
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+	*server.log << "Job " << request.job_number << ": " << (succeeded ? "Done" : "FAILED") << " after " << seconds
+		<< " seconds. Cached: " << server.cache->averagesHeld() << " average(s) and " << server.cache->framesHeld()
+		<< " frame(s), " << (server.cache->bytesUsed() / (1024 * 1024)) << " MB." << std::endl;
+	removeSpooled(request);
+	close(FD);
+}
+
+//Read a request on its own thread. A shutdown is carried out right away, and anything else is refused or queued.
+static void readAndQueue(ServerState &server, int fd, int job_number)
+{
+	JobRequest request;
+	request.fd = fd;
+	request.job_number = job_number;
+	bool shutdown;
+	std::string problem = readRequest(server.socket_filename, request, &shutdown);
+	bool queued = false;
+	if(problem.empty()){
+		//Checked and changed under the mutex, so nothing is queued once the job workers may have stopped.
+		std::lock_guard<std::mutex> lock(server.mutex);
+		if(shutdown){
+			server.stopping = true;
+		}
+		else if(server.stopping){
+			problem = "The job server is shutting down.";
+		}
+		else{
+			server.waiting.push_back(request);
+			queued = true;
+		}
+	}
+	if(!problem.empty()){
+		*server.log << "Job " << job_number << ": Refused. " << problem << std::endl;
+		sendAll(fd, "error ERROR: " + problem + "\nfailed\n");
+		removeSpooled(request);
+		close(fd);
+	}
+	else if(shutdown){
+		*server.log << "Job " << job_number << ": Asked to shut down." << std::endl;
+		sendAll(fd, "done\n");
+		close(fd);
+	}
+	else if(queued){
+		sendAll(fd, "queued " + std::to_string(job_number) + "\n");
+	}
+	std::lock_guard<std::mutex> lock(server.mutex);
+	--server.reading;
+	server.cv.notify_all();
+}
+
+static void workerLoop(ServerState &server)
+{
+	while(true){
+		JobRequest request;
+		{
+			std::unique_lock<std::mutex> lock(server.mutex);
+			server.cv.wait(lock, [&server]() { return server.stopping || !server.waiting.empty(); });
+			if(server.waiting.empty()){
+				return;
+			}
+			request = server.waiting.front();
+			server.waiting.pop_front();
+		}
+		runRequest(server, request);
+		server.cv.notify_all();
+	}
+}
+
+//Fill in addr for socket_filename. Returns false if the name is too long for a UNIX domain socket.
+static bool socketAddress(const std::string &socket_filename, struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if(socket_filename.empty() || socket_filename.size() >= sizeof(addr->sun_path)){
+		std::cerr << "ERROR: Invalid socket file name (it can be at most " << sizeof(addr->sun_path) - 1 << " characters): "
+			<< socket_filename << "\n";
+		return false;
+	}
+	strcpy(addr->sun_path, socket_filename.c_str());
+	return true;
+}
+
+//Connect to the server at socket_filename. Returns -1 if there isn't one.
+static int connectTo(const std::string &socket_filename)
+{
+	struct sockaddr_un addr;
+	if(!socketAddress(socket_filename, &addr)){
+		return -1;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0){
+		return -1;
+	}
+	if(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0){
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+//Anyone who can connect to the server can have it read and write files as this user, so the socket has to be in a
+//folder that belongs to this user and that no one else can get into. The folder is made if it isn't there yet.
+static bool privateFolder(const std::string &socket_filename)
+{
+	const size_t SLASH = socket_filename.rfind('/');
+	const std::string FOLDER = (SLASH == std::string::npos) ? "." : (SLASH == 0) ? "/" : socket_filename.substr(0, SLASH);
+	struct stat st;
+	if(lstat(FOLDER.c_str(), &st) != 0 && errno == ENOENT){
+		mkdir(FOLDER.c_str(), 0700);
+	}
+	if(lstat(FOLDER.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 077) != 0){
+		std::cerr << "ERROR: The socket file has to be in a folder that belongs to you and that no one else can get into, "
+			<< "so that no one else can send the server jobs. " << FOLDER << " isn't one.\n";
+		return false;
+	}
+	return true;
+}
+
+int serveJobs(const std::string &socket_filename, int job_workers, double cache_megabytes, int threads)
+{
+	struct sockaddr_un addr;
+	if(!socketAddress(socket_filename, &addr) || !privateFolder(socket_filename)){
+		return 1;
+	}
+	//A socket file that nothing answers on is left over from a server that didn't get to clean up.
+	int existing = connectTo(socket_filename);
+	if(existing >= 0){
+		close(existing);
+		std::cerr << "ERROR: A job server is already running at " << socket_filename << "\n";
+		return 1;
+	}
+	unlink(socket_filename.c_str());
+	//Only this user can connect, from the moment the socket file appears.
+	const mode_t ORIGINAL_UMASK = umask(077);
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	bool listening = listener >= 0 && bind(listener, (struct sockaddr *) &addr, sizeof(addr)) == 0;
+	umask(ORIGINAL_UMASK);
+	listening = listening && chmod(socket_filename.c_str(), 0600) == 0 && listen(listener, 64) == 0;
+	if(!listening){
+		std::cerr << "ERROR: Couldn't listen at " << socket_filename << ": " << strerror(errno) << "\n";
+		if(listener >= 0){
+			close(listener);
+		}
+		return 1;
+	}
+	//A client that hangs up in the middle of its job shouldn't take the server down with it.
+	signal(SIGPIPE, SIG_IGN);
+
+	job_workers = std::max(job_workers, 1);
+	ThreadPool pool(std::max(threads, 0));
+	WarmCache cache((size_t) (std::max(0.0, cache_megabytes) * 1024 * 1024));
+	ClientStreamBuf out(std::cout.rdbuf(), 0, "progress "), err(std::cerr.rdbuf(), 1, "error ");
+	std::streambuf *original_out = std::cout.rdbuf(&out);
+	std::streambuf *original_err = std::cerr.rdbuf(&err);
+	std::ostream log(original_out);
+
+	ServerState server;
+	server.socket_filename = socket_filename;
+	server.pool = &pool;
+	server.cache = &cache;
+	server.out = &out;
+	server.err = &err;
+	server.log = &log;
+	server.reading = 0;
+	server.stopping = false;
+	log << "Job server listening at " << socket_filename << ", running up to " << job_workers << " job(s) at once with "
+		<< pool.size() << " thread(s) and a " << std::max(0.0, cache_megabytes) << " MB cache." << std::endl;
+
+	std::vector<std::thread> workers;
+	for(int w = 0; w < job_workers; ++w){
+		workers.push_back(std::thread(workerLoop, std::ref(server)));
+	}
+	int jobs_accepted = 0;
+	//The accept thread only accepts: each request is read on a thread of its own (see readAndQueue), so a client that's
+	//slow to send its request, or sends nothing at all, doesn't hold up anyone else's. Only the jobs themselves go to
+	//the job workers. Wake up now and then to see whether a request has asked the server to stop.
+	while(!server.stopping){
+		struct pollfd waiting_for;
+		waiting_for.fd = listener;
+		waiting_for.events = POLLIN;
+		waiting_for.revents = 0;
+		if(poll(&waiting_for, 1, 250) <= 0){
+			continue;
+		}
+		int fd = accept(listener, NULL, NULL);
+		if(fd < 0){
+			continue;
+		}
+		struct timeval request_timeout = {REQUEST_SECONDS, 0}, send_timeout = {SEND_SECONDS, 0};
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &request_timeout, sizeof(request_timeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+		++jobs_accepted;
+		bool too_many;
+		{
+			std::lock_guard<std::mutex> lock(server.mutex);
+			too_many = server.reading >= MAX_READING;
+			server.reading += too_many ? 0 : 1;
+		}
+		if(too_many){
+			sendAll(fd, "error ERROR: Too many requests are arriving at once. Try again in a moment.\nfailed\n");
+			close(fd);
+			continue;
+		}
+		std::thread(readAndQueue, std::ref(server), fd, jobs_accepted).detach();
+	}
+	close(listener);
+	unlink(socket_filename.c_str());
+	{
+		//Requests still arriving are turned away (see readAndQueue), but their threads still have to finish.
+		std::unique_lock<std::mutex> lock(server.mutex);
+		server.cv.wait(lock, [&server]() { return server.reading == 0; });
+	}
+	server.cv.notify_all();
+	for(size_t w = 0; w < workers.size(); ++w){
+		workers[w].join();
+	}
+	rmdir((socket_filename + ".jobs").c_str());
+	std::cout.rdbuf(original_out);
+	std::cerr.rdbuf(original_err);
+	std::cout << "Job server stopped after " << jobs_accepted << " request(s)." << std::endl;
+	return 0;
+}
+
+//Send request to the server, and print what comes back until it's done.
+static int sendRequest(const std::string &socket_filename, const std::string &request)
+{
+	int fd = connectTo(socket_filename);
+	if(fd < 0){
+		std::cerr << "ERROR: No job server is answering at " << socket_filename << "\n";
+		return 1;
+	}
+	signal(SIGPIPE, SIG_IGN);
+	if(!sendAll(fd, request)){
+		std::cerr << "ERROR: The job server hung up.\n";
+		close(fd);
+		return 1;
+	}
+	LineReader reader(fd);
+	std::string line;
+	int status = -1;
+	while(status < 0 && reader.readLine(&line)){
+		if(line.compare(0, 9, "progress ") == 0){
+			std::cout << line.substr(9) << std::endl;
+		}
+		else if(line.compare(0, 6, "error ") == 0){
+			std::cerr << line.substr(6) << std::endl;
+		}
+		else if(line == "done"){
+			status = 0;
+		}
+		else if(line == "failed"){
+			status = 1;
+		}
+	}
+	close(fd);
+	if(status < 0){
+		std::cerr << "ERROR: The job server hung up before the job was done.\n";
+		return 1;
+	}
+	return status;
+}
+
+int submitJobs(const std::string &socket_filename, const std::vector<std::string> &settings_filenames)
+{
+	//The server may well have been started in another folder, so it's sent full paths.
+	std::string request;
+	for(size_t f = 0; f < settings_filenames.size(); ++f){
+		char resolved[PATH_MAX];
+		if(realpath(settings_filenames[f].c_str(), resolved) == NULL){
+			std::cerr << "ERROR: Couldn't find settings file " << settings_filenames[f] << "\n";
+			return 1;
+		}
+		request += "file " + std::string(resolved) + "\n";
+	}
+	return sendRequest(socket_filename, request + "run\n");
+}
+
+int stopJobServer(const std::string &socket_filename)
+{
+	return sendRequest(socket_filename, "shutdown\n");
+}
+
+#endif //_WIN32
@@ -0,0 +1,46 @@
+// LeastAverageImage
+// Andrew Eckel
+// jobserver.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef JOBSERVER_H
+#define JOBSERVER_H
+
+#include <string>
+#include <vector>
+
+//Job server mode: one long-running process that takes jobs over a UNIX domain socket, so that a job doesn't have to
+//start up a new process, a new thread pool, and cold caches. Averages and decoded frames are kept in memory (up to
+//cache_megabytes) from one job to the next, so a job over the same frames as an earlier one skips its averaging
+//phase, and reads none of the frames that are still in the cache.
+//
+//Each connection is one request, made of lines:
+//  file <settings file>              A settings file on this machine. Relative paths, in the request and in the settings
+//                                    file, are relative to the folder the server was started in.
+//  settings <name> <length>          Followed by <length> bytes: the contents of a settings file called <name>.
+//  run                               Run the settings files above, like "lai <settings file> ...". (So settings files
+//                                    that read the same frames are run together.)
+//  shutdown                          Stop taking requests right away, finish the jobs already waiting, then stop.
+//A request has to arrive within 10 seconds, with no line longer than 64 KB and no settings file bigger than 1 MB.
+//The server answers with lines too:
+//  queued <job number>               As soon as the request has been read.
+//  progress <line>                   Everything the job prints,
+//  error <line>                      and everything it prints as an error, as it goes.
+//  done, or failed                   At the end.
+//Up to job_workers jobs run at once, sharing one pool of threads (0 for one per logical core). A job that would write
+//the same files as one that's running (the same output path and tag, or the same input manifest) waits for it first.
+//Only this user can connect: the socket file's folder has to belong to this user and be closed to everyone else (it's
+//made if it doesn't exist), and the socket file itself is made readable and writable by this user only.
+//Returns the program's exit status.
+int serveJobs(const std::string &socket_filename, int job_workers, double cache_megabytes, int threads);
+
+//Send settings files to a job server to run, and print what it sends back as the job goes.
+//Returns the program's exit status: 0 if the job is done, 1 if it failed.
+int submitJobs(const std::string &socket_filename, const std::vector<std::string> &settings_filenames);
+
+//Ask a job server to stop once the jobs already waiting are done.
+int stopJobServer(const std::string &socket_filename);
+
+#endif //JOBSERVER_H
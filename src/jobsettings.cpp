@@ -0,0 +1,378 @@
+// LeastAverageImage
+// Andrew Eckel
+// jobsettings.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#include "jobsettings.h"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <stdlib.h>
+
+#include "iniparser.h"
+#include "utility.h"
+#include "framecontainer.h"
+
+JobSettings readJobSettings(const std::string &settings_filename, bool packing)
+{
+	JobSettings settings;
+	settings.settings_filename = settings_filename;
+	ini opts_ini(settings_filename);
+	std::cout << "Parsing input file " << settings_filename << std::endl;
+
+	//General settings
+	settings.output_path = Utility::endWithSlash(opts_ini.atat("general_output_path"));
+	settings.invert_scores = Utility::stob(opts_ini.atat("general_invert_scores"));
+	settings.save_average = Utility::stob(opts_ini.atat("general_save_average"));
+
+	const std::string split_chars = ",";
+	settings.powers_of_score = Utility::toDoubles(Utility::splitByChars(opts_ini.atat("general_powers_of_score"), split_chars), true);
+	settings.rankings_to_save = Utility::toInts(Utility::splitByChars(opts_ini.atat("general_rankings_to_save"), split_chars), true);
+	std::sort(settings.rankings_to_save.begin(), settings.rankings_to_save.end(), std::greater<int>());  //Reverse-sort numbers of rankings.
+	settings.num_pixels_to_rank = settings.rankings_to_save[0];  //Whater is the greatest number of rankings desired, that's how many we'll need to do.
+	try{
+		settings.allow_resizing_and_cropping = Utility::stob(opts_ini.atat("general_allow_resizing_and_cropping_to_average_shape"));
+		settings.average_dimensions_multiplier = std::stod(opts_ini.atat("general_average_dimensions_multiplier"));
+	} catch(const std::exception &){
+		std::cout << "WARNING: No setting found for allow_resizing_and_cropping_to_average_shape and/or average_dimensions_multiplier. Assuming false.\n";
+		settings.allow_resizing_and_cropping = false;
+		settings.average_dimensions_multiplier = 1.0;
+	}
+	try{
+		settings.num_threads = std::stoi(opts_ini.atat("general_threads"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for threads. Assuming 0 (one thread per logical core).\n";
+		settings.num_threads = 0;
+	}
+	if(settings.num_threads < 0){
+		std::cerr << "ERROR: Invalid number of threads: " << settings.num_threads << "\n";
+		throw RunError();
+	}
+	try{
+		settings.frame_cache_megabytes = std::stod(opts_ini.atat("general_frame_cache_megabytes"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for frame_cache_megabytes. Assuming 0 (no frame cache).\n";
+		settings.frame_cache_megabytes = 0.0;
+	}
+	try{
+		settings.decoder_threads = std::stoi(opts_ini.atat("general_decoder_threads"));
+		settings.prefetch_depth = std::stoi(opts_ini.atat("general_prefetch_depth"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for decoder_threads and/or prefetch_depth. Assuming 2 and 4.\n";
+		settings.decoder_threads = 2;
+		settings.prefetch_depth = 4;
+	}
+	if(settings.decoder_threads < 0 || settings.prefetch_depth < 1){
+		std::cerr << "ERROR: Invalid decoder_threads (" << settings.decoder_threads << ") or prefetch_depth (" << settings.prefetch_depth << ")\n";
+		throw RunError();
+	}
+	try{
+		settings.tile_rows = std::stoi(opts_ini.atat("general_tile_rows"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for tile_rows. Assuming 0 (no tiling).\n";
+		settings.tile_rows = 0;
+	}
+	if(settings.tile_rows < 0){
+		std::cerr << "ERROR: Invalid tile_rows: " << settings.tile_rows << "\n";
+		throw RunError();
+	}
+	const bool TILED = settings.tile_rows > 0;
+	std::string score_precision_name;
+	try{
+		score_precision_name = Utility::trim(opts_ini.atat("general_score_precision"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for score_precision. Assuming double.\n";
+		score_precision_name = "double";
+	}
+	if(score_precision_name == "double"){
+		settings.score_precision = RankingBuffer::DOUBLE_SCORES;
+	}
+	else if(score_precision_name == "float"){
+		settings.score_precision = RankingBuffer::FLOAT_SCORES;
+	}
+	else if(score_precision_name == "16bit"){
+		settings.score_precision = RankingBuffer::QUANTIZED_SCORES;
+	}
+	else{
+		std::cerr << "ERROR: Invalid score_precision: " << score_precision_name << " (should be double, float, or 16bit)\n";
+		throw RunError();
+	}
+	if(TILED && settings.frame_cache_megabytes > 0){
+		std::cout << "WARNING: The frame cache is not used when tile_rows is set.\n";
+		settings.frame_cache_megabytes = 0.0;
+	}
+	try{
+		settings.checkpoint_interval = std::stoi(opts_ini.atat("general_checkpoint_interval"));
+		settings.resume = Utility::stob(opts_ini.atat("general_resume"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for checkpoint_interval and/or resume. Assuming 0 (no checkpoints) and false.\n";
+		settings.checkpoint_interval = 0;
+		settings.resume = false;
+	}
+	if(settings.checkpoint_interval < 0){
+		std::cerr << "ERROR: Invalid checkpoint_interval: " << settings.checkpoint_interval << "\n";
+		throw RunError();
+	}
+	if(TILED && (settings.checkpoint_interval > 0 || settings.resume)){
+		std::cout << "WARNING: Checkpoints are not written or resumed when tile_rows is set.\n";
+		settings.checkpoint_interval = 0;
+		settings.resume = false;
+	}
+	try{
+		settings.reference_sample_frames = std::stoi(opts_ini.atat("general_reference_sample_frames"));
+		settings.reference_sampling = Utility::trim(opts_ini.atat("general_reference_sampling"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for reference_sample_frames and/or reference_sampling. Assuming 0 (average every frame).\n";
+		settings.reference_sample_frames = 0;
+		settings.reference_sampling = "strided";
+	}
+	if(settings.reference_sample_frames < 0 || (settings.reference_sampling != "strided" && settings.reference_sampling != "random")){
+		std::cerr << "ERROR: Invalid reference_sample_frames (" << settings.reference_sample_frames << ") or reference_sampling ("
+			<< settings.reference_sampling << ", should be strided or random)\n";
+		throw RunError();
+	}
+	try{
+		settings.input_manifest = Utility::stob(opts_ini.atat("general_input_manifest"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for input_manifest. Assuming false.\n";
+		settings.input_manifest = false;
+	}
+	try{
+		settings.write_report = Utility::stob(opts_ini.atat("general_report"));
+		settings.write_trace = Utility::stob(opts_ini.atat("general_trace"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for report and/or trace. Assuming false.\n";
+		settings.write_report = false;
+		settings.write_trace = false;
+	}
+
+	//Which difference functions should we use?
+	settings.do_regular = Utility::stob(opts_ini.atat("difference_functions_do_regular"));
+	settings.do_perceived_brightness = Utility::stob(opts_ini.atat("difference_functions_do_perceived_brightness"));
+	settings.do_color_ratio = Utility::stob(opts_ini.atat("difference_functions_do_color_ratio"));
+	try{
+		settings.do_inverted_color_ratio = Utility::stob(opts_ini.atat("difference_functions_do_inverted_color_ratio"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for do_inverted_color_ratio. Assuming false.\n";
+		settings.do_inverted_color_ratio = false;
+	}
+	try{
+		settings.do_half_inverted_color_ratio = Utility::stob(opts_ini.atat("difference_functions_do_half_inverted_color_ratio"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for do_half_inverted_color_ratio. Assuming false.\n";
+		settings.do_half_inverted_color_ratio = false;
+	}
+	try{
+		settings.do_inverted_enumerator_color_ratio = Utility::stob(opts_ini.atat("difference_functions_do_inverted_enumerator_color_ratio"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for do_inverted_enumerator_color_ratio. Assuming false.\n";
+		settings.do_inverted_enumerator_color_ratio = false;
+	}
+	try{
+		settings.do_experiment = Utility::stob(opts_ini.atat("difference_functions_do_experiment"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for do_experiment. Assuming false.\n";
+		settings.do_experiment = false;
+	}
+	settings.do_combo = Utility::stob(opts_ini.atat("difference_functions_do_combo"));
+
+	if(settings.do_regular +
+		settings.do_perceived_brightness +
+		settings.do_color_ratio +
+		settings.do_inverted_color_ratio +
+		settings.do_half_inverted_color_ratio +
+		settings.do_inverted_enumerator_color_ratio +
+		settings.do_combo +
+		settings.do_experiment == 0){
+			std::cerr << "ERROR: No difference functions selected.\n";
+			throw RunError();
+	}
+
+	//Pre-Averaged
+	settings.skip_averaging_phase = Utility::stob(opts_ini.atat("pre_averaged_skip_averaging_phase"));
+	if(settings.skip_averaging_phase){
+		settings.pre_averaged_filename = Utility::endWithSlash(opts_ini.atat("pre_averaged_pre_averaged_path")) +
+		                                 opts_ini.atat("pre_averaged_pre_averaged_filename");
+	}
+
+	//List mode settings
+	settings.list_mode = Utility::stob(opts_ini.atat("list_mode_list_mode"));
+	const bool USE_ALBUM_INPUT_PATH_FOR_LIST_MODE = Utility::stob(opts_ini.atat("list_mode_use_input_path_from_album_mode"));
+	const bool USE_ALTERNATIVE_TAG_FOR_LIST_MODE = Utility::stob(opts_ini.atat("list_mode_use_alternative_tag"));
+	const std::string ALTERNATIVE_TAG_FOR_LIST_MODE = opts_ini.atat("list_mode_alternative_tag");
+
+	//Album mode settings
+	//(New mode coming soon...)
+	const std::string ALBUM_INPUT_PATH = Utility::endWithSlash(opts_ini.atat("album_mode_input_path"));
+	const std::string ALBUM_NAME = opts_ini.atat("album_mode_name");
+	const int FIRST_FRAME = std::stoi(opts_ini.atat("album_mode_first_frame"));
+	const int LAST_FRAME = std::stoi(opts_ini.atat("album_mode_last_frame"));
+	const int ALBUM_NUM_DIGITS = std::stoi(opts_ini.atat("album_mode_num_digits"));
+
+	//Stream mode settings
+	try{
+		settings.stream_mode = Utility::stob(opts_ini.atat("stream_mode_stream_mode"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for stream_mode. Assuming false.\n";
+		settings.stream_mode = false;
+	}
+	std::string STREAM_NAME;
+	settings.stream_format = FrameStream::Y4M;
+	settings.stream_width = 0;
+	settings.stream_height = 0;
+	if(settings.stream_mode){
+		settings.stream_input = Utility::trim(opts_ini.atat("stream_mode_input"));
+		STREAM_NAME = opts_ini.atat("stream_mode_name");
+		settings.stream_spool_path = Utility::endWithSlash(opts_ini.atat("stream_mode_spool_path"));
+		if(!FrameStream::parseFormat(Utility::trim(opts_ini.atat("stream_mode_format")), &settings.stream_format)){
+			std::cerr << "ERROR: Invalid stream format: " << opts_ini.atat("stream_mode_format") << " (should be y4m or rgb24)\n";
+			throw RunError();
+		}
+		if(settings.stream_format == FrameStream::RGB24){
+			settings.stream_width = std::stoi(opts_ini.atat("stream_mode_width"));
+			settings.stream_height = std::stoi(opts_ini.atat("stream_mode_height"));
+		}
+		if(settings.list_mode){
+			std::cerr << "ERROR: list_mode and stream_mode can't both be used.\n";
+			throw RunError();
+		}
+		if(TILED){
+			std::cerr << "ERROR: tile_rows can't be used in stream mode.\n";
+			throw RunError();
+		}
+		if(settings.checkpoint_interval > 0 || settings.resume || settings.reference_sample_frames > 0){
+			std::cout << "WARNING: checkpoint_interval, resume, and reference_sample_frames are not used in stream mode.\n";
+			settings.checkpoint_interval = 0;
+			settings.resume = false;
+			settings.reference_sample_frames = 0;
+		}
+	}
+
+	//Container mode settings
+	try{
+		settings.container_mode = Utility::stob(opts_ini.atat("container_mode_container_mode"));
+	} catch(const std::exception &e){
+		std::cout << "WARNING: No value found for container_mode. Assuming false.\n";
+		settings.container_mode = false;
+	}
+	if(settings.container_mode && !packing){
+		settings.container_file = Utility::trim(opts_ini.atat("container_mode_file"));
+		if(settings.list_mode || settings.stream_mode){
+			std::cerr << "ERROR: container_mode can't be used with list_mode or stream_mode.\n";
+			throw RunError();
+		}
+	}
+	else{
+		settings.container_mode = false;
+	}
+
+	if(!settings.list_mode && !settings.stream_mode && !settings.container_mode && (LAST_FRAME <= FIRST_FRAME || FIRST_FRAME < 0)){
+		std::cerr << "Invalid frame numbers for album mode: " << FIRST_FRAME << " through " << LAST_FRAME << "\n";
+		throw RunError();
+	}
+
+	std::cout << "Finished parsing." << std::endl;
+
+	if(settings.stream_mode){
+		//STREAM MODE
+		//There are no input files; the frames are counted as they come in.
+		settings.output_tag = STREAM_NAME;
+	}
+	else if(settings.container_mode){
+		//CONTAINER MODE
+		//The tag is the container's filename, without the path or extension.
+		FrameContainer container(settings.container_file);
+		std::vector<std::string> v1 = Utility::splitByChars(settings.container_file, "/\\");
+		settings.output_tag = v1[v1.size() - 1];
+		if(settings.output_tag.rfind(".") != std::string::npos && settings.output_tag.rfind(".") > 0){
+			settings.output_tag = settings.output_tag.substr(0, settings.output_tag.rfind("."));
+		}
+		for(int x = 0; x < container.frames(); ++x){
+			settings.inputFilenames.push_back(settings.container_file + "#" + std::to_string(x + 1));
+		}
+		std::cout << "Found " << container.frames() << " frames in container file " << settings.container_file << "." << std::endl;
+	}
+	else if(settings.list_mode){
+		//LIST MODE
+		//Input tag
+		if(USE_ALTERNATIVE_TAG_FOR_LIST_MODE){
+			settings.output_tag = ALTERNATIVE_TAG_FOR_LIST_MODE;
+		}
+		else{
+			//The tag will the the settings filename, without the path or extension (.ini).
+			//First, get everything after the last slash:
+			std::string slashes = "/\\";
+			std::vector<std::string> v1 = Utility::splitByChars(settings_filename, slashes);
+			std::string s1 = v1[v1.size() -1];
+			//Next, get everything before the last period:
+			std::string s2;
+			if(s1.find(".") == std::string::npos){
+				s2 = s1;
+			}
+			else{
+				std::vector<std::string> v2 = Utility::splitByChars(s1, ".");
+				s2 = "";
+				for(size_t x = 0; x < v2.size() - 1; ++x){
+					s2 += v2[x];
+				}
+				settings.output_tag = s2;
+			}
+		}
+		//Input filenames: Every non-blank line after "[list]" in the settings file
+		std::ifstream listfile(settings_filename);
+		std::string line = "";
+		while(std::getline(listfile, line) && line != "[list]" && line != "[list]\r"){ }
+		while(std::getline(listfile, line)){
+			line = Utility::trim(line);
+			if(line.length() > 0 && line[0] != '#'){ //ignore blank lines and comments beginning with #
+				if(USE_ALBUM_INPUT_PATH_FOR_LIST_MODE){
+					settings.inputFilenames.push_back(ALBUM_INPUT_PATH + line);
+				}
+				else{
+					settings.inputFilenames.push_back(line);
+				}
+			}
+		}
+		if(settings.inputFilenames.size() == 0){
+			std::cerr << "ERROR: No list found for list mode in " << settings_filename << "\n";
+			throw RunError();
+		}
+	}
+	else{
+		//ALBUM MODE
+		settings.output_tag = ALBUM_NAME + Utility::intToString(FIRST_FRAME, ALBUM_NUM_DIGITS) + "-" + Utility::intToString(LAST_FRAME, ALBUM_NUM_DIGITS);
+		for(int x = FIRST_FRAME; x <= LAST_FRAME; ++x){
+			settings.inputFilenames.push_back(ALBUM_INPUT_PATH + ALBUM_NAME + Utility::intToString(x, ALBUM_NUM_DIGITS) + ".ppm");
+		}
+	}
+	return settings;
+}
+
+std::vector<std::string> readBatchFile(const std::string &batch_filename)
+{
+	std::ifstream batchfile(batch_filename);
+	if(!batchfile){
+		std::cerr << "ERROR: Couldn't open batch file " << batch_filename << "\n";
+		throw RunError();
+	}
+	size_t last_slash = batch_filename.find_last_of("/\\");
+	const std::string BATCH_PATH = (last_slash == std::string::npos) ? std::string("") : batch_filename.substr(0, last_slash + 1);
+	std::vector<std::string> settingsFilenames;
+	std::string line;
+	while(std::getline(batchfile, line)){
+		line = Utility::trim(line);
+		if(line.length() > 0 && line[0] != '#'){ //ignore blank lines and comments beginning with #
+			const bool ABSOLUTE_PATH = line[0] == '/' || line[0] == '\\' || (line.length() > 1 && line[1] == ':');
+			settingsFilenames.push_back(ABSOLUTE_PATH ? line : BATCH_PATH + line);
+		}
+	}
+	if(settingsFilenames.empty()){
+		std::cerr << "ERROR: No settings files found in batch file " << batch_filename << "\n";
+		throw RunError();
+	}
+	return settingsFilenames;
+}
@@ -0,0 +1,79 @@
+// LeastAverageImage
+// Andrew Eckel
+// jobsettings.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef JOBSETTINGS_H
+#define JOBSETTINGS_H
+
+#include <string>
+#include <vector>
+
+#include "differencerecord.h"
+#include "framestream.h"
+
+//Everything one settings file asks for, with its input files already worked out.
+typedef struct
+{
+	std::string settings_filename; //INCLUDES PATH
+
+	//General settings
+	std::string output_path; //Ends with a slash.
+	bool invert_scores;
+	bool save_average;
+	std::vector<double> powers_of_score;
+	std::vector<int> rankings_to_save; //Greatest first.
+	int num_pixels_to_rank; //The greatest of rankings_to_save.
+	bool allow_resizing_and_cropping;
+	double average_dimensions_multiplier;
+	int num_threads;
+	double frame_cache_megabytes;
+	int decoder_threads, prefetch_depth;
+	int tile_rows;
+	RankingBuffer::Precision score_precision;
+	int checkpoint_interval;
+	bool resume;
+	int reference_sample_frames;
+	std::string reference_sampling;
+	bool input_manifest;
+	bool write_report, write_trace;
+
+	//Which difference functions should we use?
+	bool do_regular, do_perceived_brightness, do_color_ratio, do_inverted_color_ratio, do_half_inverted_color_ratio,
+	     do_inverted_enumerator_color_ratio, do_combo, do_experiment;
+
+	//Pre-Averaged
+	bool skip_averaging_phase;
+	std::string pre_averaged_filename; //INCLUDES PATH
+
+	bool list_mode;
+
+	//Stream mode
+	bool stream_mode;
+	std::string stream_input, stream_spool_path;
+	FrameStream::Format stream_format;
+	int stream_width, stream_height;
+
+	//Container mode
+	bool container_mode;
+	std::string container_file;
+
+	//Worked out from the mode: the name every output file starts with, and the frames (in stream mode, none).
+	//In container mode, the frames are named by their numbers in the container (which is all the names are needed
+	//for, besides messages).
+	std::string output_tag;
+	std::vector<std::string> inputFilenames; //INCLUDES PATHS
+} JobSettings;
+
+//Read a settings file. Settings that are missing get their defaults (with a warning), and invalid ones throw a RunError
+//(after printing what's wrong).
+//With packing true, the settings are only wanted for their input files, so container mode is ignored.
+JobSettings readJobSettings(const std::string &settings_filename, bool packing = false);
+
+//Read a batch file: the settings files named on each of its non-blank lines (besides comments beginning with #).
+//Relative names are relative to the batch file's folder.
+std::vector<std::string> readBatchFile(const std::string &batch_filename);
+
+#endif //JOBSETTINGS_H
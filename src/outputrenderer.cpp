@@ -0,0 +1,179 @@
+// LeastAverageImage
+// Andrew Eckel
+// outputrenderer.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#include "outputrenderer.h"
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <math.h>
+
+Image renderOutput(const OutputJob &job, const Image &meanAverageImage, int *equal_i, int *equal_j)
+{
+	const RankingBuffer &rankings = job.dr->rankings;
+	Image result_img = createImageUninitialized(meanAverageImage.height, meanAverageImage.width);
+	std::vector<double> scores(rankings.rankings());
+	std::vector<double> poweredScores(job.num_rankings);
+	*equal_i = -1;
+	*equal_j = -1;
+	for(int i = 0; i < result_img.height; ++i){
+		for(int j = 0; j < result_img.width; ++j){
+			size_t pixel = rankings.pixelIndex(i, j);
+			rankings.scoresAt(pixel, &scores[0]);
+			const Pixel *colors = rankings.colorsAt(pixel);
+			double totalScore = 0.0;
+			for(int k = 0; k < job.num_rankings; ++k){
+				poweredScores[k] = pow(scores[k], job.power);
+				totalScore += poweredScores[k];
+			}
+			if(totalScore <= 0.0){
+				if(*equal_i < 0){
+					*equal_i = i;
+					*equal_j = j;
+				}
+				copyPixel(&result_img.map[i][j], &meanAverageImage.map[i][j]);
+			}
+			else{
+				double newR = 0.0, newG = 0.0, newB = 0.0;
+				for(int k = 0; k < job.num_rankings; ++k){
+					double weight = poweredScores[k] / totalScore;
+					if(job.dr->invert_scores){
+						weight = 1 - weight;
+					}
+					newR += colors[k].r * weight;
+					newG += colors[k].g * weight;
+					newB += colors[k].b * weight;
+				}
+				result_img.map[i][j].r = (unsigned char) round(newR);
+				result_img.map[i][j].g = (unsigned char) round(newG);
+				result_img.map[i][j].b = (unsigned char) round(newB);
+			}
+		}
+	}
+	return result_img;
+}
+
+//What a render task hands over to the writer.
+//Held by shared_ptr, like the thread pool's BandJob, so a task can never outlive the things it touches.
+struct RenderResults
+{
+	std::vector<Image> images;
+	std::vector<int> equal_i, equal_j;
+	std::vector<bool> rendered;
+	std::vector<std::exception_ptr> errors; //If a render threw instead.
+	std::mutex mutex;
+	std::condition_variable cv;
+};
+
+//Render every job as a task on the pool, and hand each finished image to handle(w, img, equal_i, equal_j) on the
+//calling thread, in the order of jobs. handle takes ownership of the image.
+//Enough renders are kept in flight to keep every thread busy while the calling thread is handling an image,
+//and no more, since each one holds a whole output image.
+static void renderInOrder(const std::vector<OutputJob> &jobs, const Image &meanAverageImage, ThreadPool &pool,
+                          const std::function<void(size_t, Image, int, int)> &handle)
+{
+	std::shared_ptr<RenderResults> results = std::make_shared<RenderResults>();
+	results->images.resize(jobs.size());
+	results->equal_i.resize(jobs.size(), -1);
+	results->equal_j.resize(jobs.size(), -1);
+	results->rendered.resize(jobs.size(), false);
+	results->errors.resize(jobs.size());
+
+	const size_t max_in_flight = pool.size() + 1;
+	size_t next_to_render = 0;
+
+	size_t w = 0;
+	try{
+		for(; w < jobs.size(); ++w){
+			while(next_to_render < jobs.size() && next_to_render < w + max_in_flight){
+				size_t r = next_to_render++;
+				const OutputJob *job = &jobs[r];
+				const Image *average = &meanAverageImage;
+				pool.enqueue([results, r, job, average](){
+					int equal_i = -1, equal_j = -1;
+					Image img = Image();
+					std::exception_ptr error;
+					try{
+						img = renderOutput(*job, *average, &equal_i, &equal_j);
+					} catch(...){
+						error = std::current_exception();
+					}
+					std::lock_guard<std::mutex> lock(results->mutex);
+					results->errors[r] = error;
+					results->images[r] = img;
+					results->equal_i[r] = equal_i;
+					results->equal_j[r] = equal_j;
+					results->rendered[r] = true;
+					results->cv.notify_all();
+				});
+			}
+
+			Image img;
+			int equal_i, equal_j;
+			{
+				std::unique_lock<std::mutex> lock(results->mutex);
+				results->cv.wait(lock, [&results, w]() { return (bool) results->rendered[w]; });
+				if(results->errors[w]){
+					std::rethrow_exception(results->errors[w]);
+				}
+				img = results->images[w];
+				equal_i = results->equal_i[w];
+				equal_j = results->equal_j[w];
+			}
+			handle(w, img, equal_i, equal_j);
+		}
+	} catch(...){
+		//The renders still in flight use jobs and meanAverageImage, so they have to finish before this returns.
+		std::unique_lock<std::mutex> lock(results->mutex);
+		results->cv.wait(lock, [&results, next_to_render]() {
+			for(size_t r = 0; r < next_to_render; ++r){
+				if(!results->rendered[r]){
+					return false;
+				}
+			}
+			return true;
+		});
+		for(size_t r = w + 1; r < next_to_render; ++r){
+			if(!results->errors[r]){
+				deleteImage(results->images[r]);
+			}
+		}
+		throw;
+	}
+}
+
+static void warnIfAllPixelsEqual(const OutputJob &job, int equal_i, int equal_j, bool *printed_all_pixels_equal_warning)
+{
+	if(equal_i >= 0 && !*printed_all_pixels_equal_warning){
+		std::cout << "WARNING: All pixels at position " << equal_i << ", " << equal_j << " are equal to the average, for " << job.dr->name << "." << std::endl;
+		*printed_all_pixels_equal_warning = true;
+	}
+}
+
+void renderAndWriteOutputs(const std::vector<OutputJob> &jobs, const Image &meanAverageImage, ThreadPool &pool)
+{
+	bool printed_all_pixels_equal_warning = false;
+	renderInOrder(jobs, meanAverageImage, pool, [&](size_t w, Image img, int equal_i, int equal_j){
+		ScopedImage output(img);
+		warnIfAllPixelsEqual(jobs[w], equal_i, equal_j, &printed_all_pixels_equal_warning);
+		writeImage(img, jobs[w].path + jobs[w].filename);
+		std::cout << "Created file " << jobs[w].filename << std::endl;
+	});
+}
+
+void renderAndAppendOutputRows(const std::vector<OutputJob> &jobs, const Image &meanAverageRows, int first_row,
+                               const std::vector<FILE *> &files, ThreadPool &pool, bool *printed_all_pixels_equal_warning)
+{
+	renderInOrder(jobs, meanAverageRows, pool, [&](size_t w, Image img, int equal_i, int equal_j){
+		ScopedImage output(img);
+		warnIfAllPixelsEqual(jobs[w], (equal_i < 0) ? -1 : first_row + equal_i, equal_j, printed_all_pixels_equal_warning);
+		writeImageRows(files[w], img);
+	});
+}
@@ -0,0 +1,45 @@
+// LeastAverageImage
+// Andrew Eckel
+// outputrenderer.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef OUTPUTRENDERER_H
+#define OUTPUTRENDERER_H
+
+#include <string>
+#include <vector>
+
+#include "ppm_functions.h"
+#include "differencerecord.h"
+#include "threadpool.h"
+
+//One output file: the top num_rankings colors of a difference record, weighted by their scores to the given power.
+typedef struct
+{
+	const DifferenceRecord *dr;
+	int num_rankings;
+	double power;
+	std::string path; //Where the file goes (ends with a slash).
+	std::string filename; //Does not include the path.
+} OutputJob;
+
+//Blend one output image from a difference record's (finished) rankings.
+//If some pixel's top scores are all zero, that pixel is copied from the average instead, and the first such pixel
+//(in row-major order) is reported through equal_i and equal_j. Otherwise they are set to -1.
+Image renderOutput(const OutputJob &job, const Image &meanAverageImage, int *equal_i, int *equal_j);
+
+//Render every job and write it to job.path + job.filename.
+//Each job is rendered as a separate task on the pool, while the calling thread writes the finished images out,
+//in the order of jobs, so the files and the messages about them come out just as if the jobs were done one by one.
+//Only a few rendered images wait to be written at any one time.
+void renderAndWriteOutputs(const std::vector<OutputJob> &jobs, const Image &meanAverageImage, ThreadPool &pool);
+
+//The same, for a strip of rows: the jobs' rankings and meanAverageRows hold only the rows starting at first_row
+//of the whole image, and each job's rows are appended to files[job index] (see beginImageFile).
+//The warning about pixels equal to the average is printed at most once, across all strips.
+void renderAndAppendOutputRows(const std::vector<OutputJob> &jobs, const Image &meanAverageRows, int first_row,
+                               const std::vector<FILE *> &files, ThreadPool &pool, bool *printed_all_pixels_equal_warning);
+
+#endif //OUTPUTRENDERER_H
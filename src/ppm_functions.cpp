@@ -4,114 +4,372 @@
 // See ppm_functions.h for details
 
 #define _CRT_SECURE_NO_WARNINGS
+#define _FILE_OFFSET_BITS 64
 
 #include "ppm_functions.h"
+#include "utility.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <float.h>
 #include <string.h>
 #include <math.h>
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <atomic>
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static_assert(sizeof(Pixel) == 3, "Pixels must be packed RGB triplets to match the PPM raster layout");
+
+// Print an error message, printf style. It goes through std::cerr, so that it ends up wherever the rest of the
+// program's error messages do (see jobserver.cpp).
+static void reportError(const char *format, ...)
+{
+	char message[1024];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(message, sizeof(message), format, args);
+	va_end(args);
+	std::cerr << message << std::flush;
+}
 
-// Create a new image of the given size and fill it with white pixels.
-// When you don't need the image anymore, don't forget to free its memory using deleteImage.
-Image createImage(int height, int width)
+// Create a new image of the given size without setting its pixels to anything.
+// The row pointer table comes first in the allocation, padded so that the pixels start on a PPM_ALIGNMENT boundary.
+Image createImageUninitialized(int height, int width)
 {
-	int i, j;
+	int i;
 	Image img;
+	size_t mapbytes = (sizeof(Pixel *)*height + PPM_ALIGNMENT - 1)/PPM_ALIGNMENT*PPM_ALIGNMENT;
+	size_t databytes = sizeof(Pixel)*(size_t) height*width;
 
-	img.map = (Pixel **) malloc(sizeof(Pixel *)*height);
-	for (i = 0; i < height; i++)
+	img.map = (Pixel **) alignedMalloc(mapbytes + databytes);
+	if (img.map == NULL)
 	{
-		img.map[i] = (Pixel *) malloc(sizeof(Pixel)*width);
-		for (j = 0; j < width; j++)
-		{
-			img.map[i][j].r = 255;
-			img.map[i][j].g = 255;
-			img.map[i][j].b = 255;
-		}
+		reportError("Not enough memory for a %d by %d image.\n", height, width);
+		throw RunError();
 	}
+	img.data = (Pixel *) ((unsigned char *) img.map + mapbytes);
+	for (i = 0; i < height; i++)
+		img.map[i] = img.data + (size_t) i*width;
 	img.height = height;
 	img.width = width;
+	img.mapping = NULL;
+	img.mapping_size = 0;
+	return img;
+}
+
+// Create a new image of the given size and fill it with white pixels.
+// When you don't need the image anymore, don't forget to free its memory using deleteImage.
+Image createImage(int height, int width)
+{
+	Image img = createImageUninitialized(height, width);
+	memset(img.data, 255, sizeof(Pixel)*(size_t) height*width);
 	return img;
 }
 
 // Delete a previously created image and free its allocated memory on the heap. 
 void deleteImage(Image img)
 {
-	int i;
-	
-	for (i = 0; i < img.height; i++)
-		free(img.map[i]);
-	free(img.map);
+	alignedFree(img.map);
+#ifndef _WIN32
+	if (img.mapping != NULL)
+		munmap(img.mapping, img.mapping_size);
+#endif
 }
 
-// Read an image from a file and allocate the required heap memory for it.
-// Notice that only PPM files are supported. Regardless of the
-// file type, all fields r, g, b, and i are filled in, with values from 0 to 255. 
-Image readImage(const char *filename)
+// Read the header of a PPM file, leaving f positioned at the first byte of the raster.
+// type receives the magic number (e.g. "P6") and must have room for 200 characters.
+// If the header is invalid, f is closed before the error is thrown.
+static void readHeader(FILE *f, const char *filename, char *type, int *width, int *height, int *imax)
 {
-	FILE *f;
-	int i, j, width, height, imax, bitsPerPixel, filesize, mapsize, mempos;
-	char type[200], line[200];
-	unsigned char *temp, output;
-	Image img;
-	Format filetype;
+	char line[200];
 
-	f = fopen(filename, "rb");
-	if (!f)
-	{
-		fprintf(stderr, "Can't open input file %s.\n", filename);
-		exit(1);
-	}
-
-	fscanf(f, "%s", type);
+	fscanf(f, "%199s", type);
 	//if (type[0] != 'P' || type[1] < '4' || type[1] > '6')
 	if (type[0] != 'P') //??
 	{
-		fprintf(stderr, "Error in %s: Only binary PPM files are supported.\n", filename);
-		exit(1);
+		reportError("Error in %s: Only binary PPM files are supported.\n", filename);
+		fclose(f);
+		throw RunError();
 	}
- 
-	filetype = PPM;
-	bitsPerPixel = 24;
-
 
 	line[0] = '#';
 	while (line[0] == '#' || line[0] == 10 || line[0] == 13)
 		fgets(line, 200, f); 
-	sscanf(line, "%d %d", &width, &height);
+	sscanf(line, "%d %d", width, height);
 
 	fgets(line, 200, f); 
-	sscanf(line, "%d", &imax);
+	sscanf(line, "%d", imax);
 
-	if (width <= 0 || height <= 0)
+	if (*width <= 0 || *height <= 0)
 	{
-		fprintf(stderr, "Invalid image size in input file %s.\n", filename);
-		exit(1);
+		reportError("Invalid image size in input file %s.\n", filename);
+		fclose(f);
+		throw RunError();
 	}
+}
+
+static ByteTotals program_bytes;
+static thread_local ByteTotals *thread_bytes = NULL;
+
+ByteTotals *countBytesInto(ByteTotals *totals)
+{
+	ByteTotals *previous = thread_bytes;
+	thread_bytes = totals;
+	return previous;
+}
+
+ByteTotals *currentByteTotals()
+{
+	return (thread_bytes != NULL) ? thread_bytes : &program_bytes;
+}
+
+void countBytesRead(unsigned long long bytes)
+{
+	currentByteTotals()->read += bytes;
+}
+
+void countBytesWritten(unsigned long long bytes)
+{
+	currentByteTotals()->written += bytes;
+}
+
+unsigned long long totalBytesRead()
+{
+	return currentByteTotals()->read;
+}
+
+unsigned long long totalBytesWritten()
+{
+	return currentByteTotals()->written;
+}
+
+// 64 bit file positions, so that rasters bigger than 2 GB can be seeked through on every platform.
+long long tell64(FILE *f)
+{
+#ifdef _WIN32
+	return _ftelli64(f);
+#else
+	return (long long) ftello(f);
+#endif
+}
+
+int seek64(FILE *f, long long offset, int origin)
+{
+#ifdef _WIN32
+	return _fseeki64(f, offset, origin);
+#else
+	return fseeko(f, (off_t) offset, origin);
+#endif
+}
+
+// Rescale every byte of a raster read from a file with a maximum value other than 255 to 0..255.
+// There are only 256 possible byte values, so the division is done once per value up front,
+// and the raster is rescaled by table lookup.
+static void rescaleRaster(unsigned char *raster, size_t size, int imax)
+{
+	unsigned char scale[256];
+	size_t n;
+	int i;
 
-	// Notice: In PBM files, every row starts with a new byte.
-	mapsize = (bitsPerPixel*width + 7)/8*height;
-	temp = (unsigned char *) malloc(mapsize);
-	// Using fread is much faster than reading byte-by-byte. 
-	filesize = fread((void *) temp, 1, mapsize, f);
+	for (i = 0; i < 256; i++)
+		scale[i] = (unsigned char) (i*255/imax);
+	for (n = 0; n < size; n++)
+		raster[n] = scale[raster[n]];
+}
+
+#ifndef _WIN32
+// Map the file up to the end of the raster, which starts at offset, into memory and point an image's rows
+// straight at the raster: no copying at all.
+// The mapping is private, so writing to the image never changes the file.
+// Returns false if the file can't be mapped (or is too short), in which case the caller should read it normally.
+static bool mapRaster(FILE *f, long long offset, int height, int width, size_t mapsize, Image *img)
+{
+	struct stat st;
+	int i;
+	void *mapping;
+
+	if (offset < 0 || fstat(fileno(f), &st) != 0 || (size_t) st.st_size < (size_t) offset + mapsize)
+		return false;
+	mapping = mmap(NULL, (size_t) offset + mapsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+	if (mapping == MAP_FAILED)
+		return false;
+	madvise(mapping, (size_t) offset + mapsize, MADV_SEQUENTIAL);
+
+	img->map = (Pixel **) alignedMalloc(sizeof(Pixel *)*height);
+	if (img->map == NULL)
+	{
+		munmap(mapping, (size_t) offset + mapsize);
+		return false;
+	}
+	img->data = (Pixel *) ((unsigned char *) mapping + offset);
+	for (i = 0; i < height; i++)
+		img->map[i] = img->data + (size_t) i*width;
+	img->height = height;
+	img->width = width;
+	img->mapping = mapping;
+	img->mapping_size = (size_t) offset + mapsize;
+	return true;
+}
+#endif
+
+// Read the header of an image file, and find out where its raster starts.
+ImageHeader readImageHeader(const std::string filename)
+{
+	FILE *f;
+	char type[200];
+	ImageHeader header;
+
+	f = fopen(filename.c_str(), "rb");
+	if (!f)
+	{
+		reportError("Can't open input file %s.\n", filename.c_str());
+		throw RunError();
+	}
+	readHeader(f, filename.c_str(), type, &header.width, &header.height, &header.imax);
+	header.p6 = (strcmp(type, "P6") == 0);
+	header.raster_offset = tell64(f);
 	fclose(f);
+	countBytesRead(header.raster_offset);
+	if (header.imax <= 0)
+	{
+		reportError("Invalid maximum color value in input file %s.\n", filename.c_str());
+		throw RunError();
+	}
+	return header;
+}
+
+// Read the raster of an open image file whose header is already known. f may be positioned anywhere.
+// If the raster can't be read, f is closed before the error is thrown.
+static Image readRaster(FILE *f, const char *filename, const ImageHeader &header)
+{
+	size_t filesize, mapsize;
+	Image img;
+
+	mapsize = sizeof(Pixel)*(size_t) header.width*header.height;
+
+#ifndef _WIN32
+	// Fast path: a P6 raster with a maximum value of 255 is already exactly what the pixels should hold.
+	if (header.p6 && header.imax == 255 && mapRaster(f, header.raster_offset, header.height, header.width, mapsize, &img))
+	{
+		countBytesRead(mapsize);
+		return img;
+	}
+#endif
+
+	// Using fread is much faster than reading byte-by-byte.
+	// The raster is read straight into the image, since the layouts are identical.
+	if (seek64(f, header.raster_offset) != 0)
+	{
+		reportError("Data missing in file %s.\n", filename);
+		fclose(f);
+		throw RunError();
+	}
+	try
+	{
+		img = createImageUninitialized(header.height, header.width);
+	}
+	catch (const RunError &)
+	{
+		fclose(f);
+		throw;
+	}
+	filesize = fread((void *) img.data, 1, mapsize, f);
+	countBytesRead(filesize);
 	if (filesize != mapsize)
 	{
-		fprintf(stderr, "Data missing in file %s.\n", filename);
-		exit(1);
+		reportError("Data missing in file %s.\n", filename);
+		deleteImage(img);
+		fclose(f);
+		throw RunError();
 	}
 
-	img = createImage(height, width);
-	for (i = 0; i < height; i++)
-		for (j = 0; j < width; j++)
-		{
-			mempos = (bitsPerPixel*width + 7)/8*i + (bitsPerPixel*j)/8;
-			img.map[i][j].r = (unsigned char) ((int) temp[mempos]*255/imax);
-			img.map[i][j].g = (unsigned char) ((int) temp[mempos + 1]*255/imax);
-			img.map[i][j].b = (unsigned char) ((int) temp[mempos + 2]*255/imax);
-		}
-	free(temp);
+	// Other maximum values need every byte rescaled to 0..255.
+	if (header.imax != 255)
+		rescaleRaster((unsigned char *) img.data, mapsize, header.imax);
+	return img;
+}
+
+// Read num_rows rows of the raster of an open image file whose header is already known, starting with first_row.
+// If the rows can't be read, f is closed before the error is thrown.
+static Image readRasterRows(FILE *f, const char *filename, const ImageHeader &header, int first_row, int num_rows)
+{
+	size_t filesize, rowsize;
+	Image img;
+
+	if (first_row < 0 || num_rows <= 0 || (long long) first_row + num_rows > header.height)
+	{
+		reportError("Rows %d to %d are outside of the %d rows in input file %s.\n",
+			first_row, first_row + num_rows - 1, header.height, filename);
+		fclose(f);
+		throw RunError();
+	}
+	rowsize = sizeof(Pixel)*(size_t) header.width;
+
+	if (seek64(f, header.raster_offset + (long long) first_row*(long long) rowsize) != 0)
+	{
+		reportError("Can't seek to row %d in input file %s.\n", first_row, filename);
+		fclose(f);
+		throw RunError();
+	}
+	try
+	{
+		img = createImageUninitialized(num_rows, header.width);
+	}
+	catch (const RunError &)
+	{
+		fclose(f);
+		throw;
+	}
+	filesize = fread((void *) img.data, 1, rowsize*num_rows, f);
+	countBytesRead(filesize);
+	if (filesize != rowsize*num_rows)
+	{
+		reportError("Data missing in file %s.\n", filename);
+		deleteImage(img);
+		fclose(f);
+		throw RunError();
+	}
+	if (header.imax != 255)
+		rescaleRaster((unsigned char *) img.data, rowsize*num_rows, header.imax);
+	return img;
+}
+
+// Read an image from a file and allocate the required heap memory for it.
+// Notice that only PPM files are supported. Regardless of the
+// file type, all fields r, g, b, and i are filled in, with values from 0 to 255. 
+Image readImage(const char *filename)
+{
+	FILE *f;
+	char type[200];
+	ImageHeader header;
+	Image img;
+
+	f = fopen(filename, "rb");
+	if (!f)
+	{
+		reportError("Can't open input file %s.\n", filename);
+		throw RunError();
+	}
+	readHeader(f, filename, type, &header.width, &header.height, &header.imax);
+	if (header.imax <= 0)
+	{
+		reportError("Invalid maximum color value in input file %s.\n", filename);
+		fclose(f);
+		throw RunError();
+	}
+	header.p6 = (strcmp(type, "P6") == 0);
+	header.raster_offset = tell64(f);
+	img = readRaster(f, filename, header);
+	fclose(f);
 	return img;
 }
 
@@ -120,66 +378,149 @@ Image readImage(const std::string filename)
 	return readImage(filename.c_str());
 }
 
+Image readImage(const std::string filename, const ImageHeader &header)
+{
+	FILE *f;
+	Image img;
+
+	f = fopen(filename.c_str(), "rb");
+	if (!f)
+	{
+		reportError("Can't open input file %s.\n", filename.c_str());
+		throw RunError();
+	}
+	img = readRaster(f, filename.c_str(), header);
+	fclose(f);
+	return img;
+}
+
+// Read only rows first_row through first_row + num_rows - 1 of an image, seeking straight past the rows before them.
+Image readImageRows(const char *filename, int first_row, int num_rows)
+{
+	FILE *f;
+	char type[200];
+	ImageHeader header;
+	Image img;
+
+	f = fopen(filename, "rb");
+	if (!f)
+	{
+		reportError("Can't open input file %s.\n", filename);
+		throw RunError();
+	}
+	readHeader(f, filename, type, &header.width, &header.height, &header.imax);
+	if (header.imax <= 0)
+	{
+		reportError("Invalid maximum color value in input file %s.\n", filename);
+		fclose(f);
+		throw RunError();
+	}
+	header.p6 = (strcmp(type, "P6") == 0);
+	header.raster_offset = tell64(f);
+	if (header.raster_offset < 0)
+	{
+		reportError("Can't seek to row %d in input file %s.\n", first_row, filename);
+		fclose(f);
+		throw RunError();
+	}
+	img = readRasterRows(f, filename, header, first_row, num_rows);
+	fclose(f);
+	return img;
+}
+
+Image readImageRows(const std::string filename, int first_row, int num_rows)
+{
+	return readImageRows(filename.c_str(), first_row, num_rows);
+}
+
+Image readImageRows(const std::string filename, const ImageHeader &header, int first_row, int num_rows)
+{
+	FILE *f;
+	Image img;
+
+	f = fopen(filename.c_str(), "rb");
+	if (!f)
+	{
+		reportError("Can't open input file %s.\n", filename.c_str());
+		throw RunError();
+	}
+	img = readRasterRows(f, filename.c_str(), header, first_row, num_rows);
+	fclose(f);
+	return img;
+}
+
 // Write an image to a file. The file format (binary PBM, PGM, or PPM) is automatically
 // chosen based on the given file name. For PBM and PGM files, only the intensity
 // (i) information is used, and for PPM files, only r, g, and b are relevant.
 void writeImage(Image img, const char *filename)
 {
-	Format filetype;
+	FILE *f = beginImageFile(filename, img.height, img.width);
+	writeImageRows(f, img);
+	endImageFile(f, filename);
+}
+
+void writeImage(Image img, const std::string filename)
+{
+	return writeImage(img, filename.c_str());
+}
+
+// Create an image file and write its header. The rows are then written with writeImageRows,
+// and the file is closed with endImageFile.
+FILE *beginImageFile(const char *filename, int height, int width)
+{
 	FILE *f;
-	int i, j, mapsize, bitsPerPixel, bitsum, mempos;
-	unsigned char *temp;
+	size_t length = strlen(filename);
 
-	switch (filename[strlen(filename) - 2])
+	if (length < 2 || (filename[length - 2] != 'p' && filename[length - 2] != 'P'))
 	{
-	case 'p':
-	case 'P': 
-		filetype = PPM;
-		bitsPerPixel = 24;
-		break;
-	default:  
-		fprintf(stderr, "Invalid output file name: %s.\n", filename);
-		exit(1);
+		reportError("Invalid output file name: %s.\n", filename);
+		throw RunError();
 	}
 
-	if (img.width <= 0 || img.height <= 0)
+	if (width <= 0 || height <= 0)
 	{
-		fprintf(stderr, "Invalid image size in output file %s.\n", filename);
-		exit(1);
-	}
-
-	// Notice: In PBM files, every row starts with a new byte.
-	mapsize = (bitsPerPixel*img.width + 7)/8*img.height;
-	// Creating linear file data in memory and then using fwrite is much faster than writing byte-by-byte. 
-	temp = (unsigned char *) malloc(mapsize);
-	mempos = 0;
-	bitsum = 0;
-	for (i = 0; i < img.height; i++){
-		for (j = 0; j < img.width; j++){
-			temp[mempos++] = img.map[i][j].r;
-			temp[mempos++] = img.map[i][j].g;
-			temp[mempos++] = img.map[i][j].b;
-		}
+		reportError("Invalid image size in output file %s.\n", filename);
+		throw RunError();
 	}
 
-
 	f = fopen(filename, "wb");
 	if (!f)
 	{
-		fprintf(stderr, "Can't open output file %s.\n", filename);
-		exit(1);
+		reportError("Can't open output file %s.\n", filename);
+		throw RunError();
 	}
 
-	fprintf(f, "P6\n# Created by ppm_functions.cpp in LeastAverageImage\n%d %d\n255\n", img.width, img.height);
+	int header_length = fprintf(f, "P6\n# Created by ppm_functions.cpp in LeastAverageImage\n%d %d\n255\n", width, height);
+	if (header_length > 0)
+		countBytesWritten(header_length);
+	return f;
+}
 
-	fwrite((void *) temp, 1, mapsize, f);
-	fclose(f);
-	free(temp);
+FILE *beginImageFile(const std::string filename, int height, int width)
+{
+	return beginImageFile(filename.c_str(), height, width);
 }
 
-void writeImage(Image img, const std::string filename)
+// Append all of rows to the file, below whatever was written before.
+// The pixels are already stored exactly the way the raster is laid out in the file, so they can be written in one go.
+void writeImageRows(FILE *f, Image rows)
 {
-	return writeImage(img, filename.c_str());
+	countBytesWritten(sizeof(Pixel)*fwrite((void *) rows.data, sizeof(Pixel), (size_t) rows.height*rows.width, f));
+}
+
+void endImageFile(FILE *f, const char *filename)
+{
+	int failed = ferror(f);
+	if (fclose(f) != 0 || failed)
+	{
+		reportError("Error writing output file %s.\n", filename);
+		throw RunError();
+	}
+}
+
+void endImageFile(FILE *f, const std::string filename)
+{
+	endImageFile(f, filename.c_str());
 }
 
 // Set color for pixel (vPos, hPos) in image img.
@@ -218,6 +559,28 @@ void copyPixel(Pixel* to, Pixel* from){
 	to->b = from->b;
 }
 
+// Allocate size bytes starting on a PPM_ALIGNMENT boundary. Returns NULL if the allocation fails.
+void *alignedMalloc(size_t size)
+{
+#ifdef _WIN32
+	return _aligned_malloc(size, PPM_ALIGNMENT);
+#else
+	void *ptr;
+	if (posix_memalign(&ptr, PPM_ALIGNMENT, size) != 0)
+		return NULL;
+	return ptr;
+#endif
+}
+
+void alignedFree(void *ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
 // Helper function for resampleBicubic
 double c(double s, int n)
 {
@@ -229,81 +592,144 @@ double c(double s, int n)
   }
 }
 
+// The four source positions (already clamped to the edges) and their weights for every target position along
+// one axis. These depend only on the source and target lengths, so each table is computed once and shared by
+// every image with the same lengths.
+struct BicubicAxis
+{
+	std::vector<int> index;
+	std::vector<double> weight;
+};
+
+// Tables that stop being used (because no more images have those sizes) are dropped once there are this many.
+#define MAX_CACHED_BICUBIC_AXES 64
+
+static std::shared_ptr<const BicubicAxis> bicubicAxis(int source, int target)
+{
+	static std::mutex cache_mutex;
+	static std::map<std::pair<int, int>, std::shared_ptr<const BicubicAxis> > cache;
+
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	std::map<std::pair<int, int>, std::shared_ptr<const BicubicAxis> >::iterator found = cache.find(std::make_pair(source, target));
+	if (found != cache.end())
+		return found->second;
+
+	std::shared_ptr<BicubicAxis> axis = std::make_shared<BicubicAxis>();
+	axis->index.resize(4*(size_t) target);
+	axis->weight.resize(4*(size_t) target);
+	double factor = (double) source/(double) target;
+	for (int t = 0; t < target; t++)
+	{
+		double orig = (double) t*factor;
+		int offset = (int) orig - 1;
+		double relpos = orig - (double) offset;
+		for (int k = 0; k < 4; k++)
+		{
+			axis->index[4*t + k] = MIN(source - 1, MAX(0, offset + k));
+			axis->weight[4*t + k] = c(relpos, k);
+		}
+	}
+	if (cache.size() >= MAX_CACHED_BICUBIC_AXES)
+		cache.clear();
+	cache[std::make_pair(source, target)] = axis;
+	return axis;
+}
+
+// Bicubic interpolation of just the window of outImage's size whose top left corner is at (first_row, first_column)
+// in the vTarget by hTarget rescaled image, written straight into outImage. Only the source rows and columns that
+// window depends on are ever read.
+// The filter is separable, so each source row that's needed is first resampled horizontally (into one of four
+// rows of doubles, kept while the output rows move down past it), and then each output row is a weighted sum of
+// four of those. Bands of output rows are done in parallel on the pool, if there is one.
+static void resampleBicubicWindow(Image inImage, int vTarget, int hTarget, int first_row, int first_column,
+                                  Image outImage, ThreadPool *pool)
+{
+	std::shared_ptr<const BicubicAxis> rows = bicubicAxis(inImage.height, vTarget);
+	std::shared_ptr<const BicubicAxis> columns = bicubicAxis(inImage.width, hTarget);
+	const int width = outImage.width;
+
+	std::function<void(int, int)> resampleRows = [&](int band_begin, int band_end){
+		// Horizontally resampled source rows, 3 doubles (r, g, b) per output column.
+		// Source row k lives in slot k % 4, and any four consecutive source rows use all four slots.
+		std::vector<double> resampled(4*3*(size_t) width);
+		int slot_row[4] = {-1, -1, -1, -1};
+		const int *col_index = &columns->index[4*(size_t) first_column];
+		const double *col_weight = &columns->weight[4*(size_t) first_column];
+
+		for (int i = band_begin; i < band_end; i++)
+		{
+			const double *h[4];
+			for (int k = 0; k < 4; k++)
+			{
+				int source_row = rows->index[4*((size_t) first_row + i) + k];
+				double *slot = &resampled[3*(size_t) width*(source_row % 4)];
+				if (slot_row[source_row % 4] != source_row)
+				{
+					const Pixel *in = inImage.map[source_row];
+					for (int j = 0; j < width; j++)
+					{
+						const int *index = col_index + 4*(size_t) j;
+						const double *weight = col_weight + 4*(size_t) j;
+						double rValue = 0.0, gValue = 0.0, bValue = 0.0;
+						for (int l = 0; l < 4; l++)
+						{
+							rValue += (double) in[index[l]].r*weight[l];
+							gValue += (double) in[index[l]].g*weight[l];
+							bValue += (double) in[index[l]].b*weight[l];
+						}
+						slot[3*j] = rValue;
+						slot[3*j + 1] = gValue;
+						slot[3*j + 2] = bValue;
+					}
+					slot_row[source_row % 4] = source_row;
+				}
+				h[k] = slot;
+			}
+
+			const double *weight = &rows->weight[4*((size_t) first_row + i)];
+			Pixel *out = outImage.map[i];
+			for (int j = 0; j < width; j++)
+			{
+				double rValue = 0.0, gValue = 0.0, bValue = 0.0;
+				for (int k = 0; k < 4; k++)
+				{
+					rValue += weight[k]*h[k][3*j];
+					gValue += weight[k]*h[k][3*j + 1];
+					bValue += weight[k]*h[k][3*j + 2];
+				}
+				out[j].r = CLAMP((int) (rValue + 0.5));
+				out[j].g = CLAMP((int) (gValue + 0.5));
+				out[j].b = CLAMP((int) (bValue + 0.5));
+			}
+		}
+	};
+	if (pool != NULL)
+		pool->parallelForBands(0, outImage.height, resampleRows);
+	else
+		resampleRows(0, outImage.height);
+}
+
 // Rescale a color image using bicubic interpolation so that the new image size is vTarget by hTarget pixels.
-Image resampleBicubic(Image inImage, int vTarget, int hTarget)
-{
-    int i, j, k, l, i_offset, j_offset, k_pixel, l_pixel;
-    double rValue, gValue, bValue, i_orig, j_orig, i_relpos, j_relpos;
-    double intensity;
-    double i_factor = (double) inImage.height/(double) vTarget;
-    double j_factor = (double) inImage.width/(double) hTarget;
-    Image outImage = createImage(vTarget, hTarget);
-
-    for (i = 0; i < vTarget; i++){
-        for (j = 0; j < hTarget; j++){
-            i_orig = (double) i*i_factor;
-            j_orig = (double) j*j_factor;
-            i_offset = (int) i_orig - 1;
-            j_offset = (int) j_orig - 1;
-            i_relpos = i_orig - (double) i_offset;
-            j_relpos = j_orig - (double) j_offset;
-
-            rValue = 0.0;
-            gValue = 0.0;
-            bValue = 0.0;
-            for (k = 0; k < 4; k++){
-                for (l = 0; l < 4; l++){
-                    k_pixel = MIN(inImage.height - 1, MAX(0, i_offset + k));
-                    l_pixel = MIN(inImage.width - 1, MAX(0, j_offset + l));
-                    rValue += (double) inImage.map[k_pixel][l_pixel].r*c(i_relpos, k)*c(j_relpos, l);
-                    gValue += (double) inImage.map[k_pixel][l_pixel].g*c(i_relpos, k)*c(j_relpos, l);
-                    bValue += (double) inImage.map[k_pixel][l_pixel].b*c(i_relpos, k)*c(j_relpos, l);
-                    outImage.map[i][j].r = CLAMP((int) (rValue + 0.5));
-                    outImage.map[i][j].g = CLAMP((int) (gValue + 0.5));
-                    outImage.map[i][j].b = CLAMP((int) (bValue + 0.5));
-                }
-            }
-        }
-    }
-    return outImage;
+Image resampleBicubic(Image inImage, int vTarget, int hTarget, ThreadPool *pool)
+{
+	Image outImage = createImageUninitialized(vTarget, hTarget);
+	resampleBicubicWindow(inImage, vTarget, hTarget, 0, 0, outImage, pool);
+	return outImage;
 }
 
 //Read in the height and width information only and return it in a pair, with height first, width second.
 std::pair<int, int> readHeightAndWidth(const std::string filename){
 	FILE *f;
 	int width, height, imax;
-	char type[200], line[200];
-
-	Format filetype;
+	char type[200];
 
 	f = fopen(filename.c_str(), "rb");
 	if (!f)
 	{
-		fprintf(stderr, "Can't open input file %s.\n", filename.c_str());
-		exit(1);
-	}
-
-	fscanf(f, "%s", type);
-	if (type[0] != 'P')
-	{
-		fprintf(stderr, "Error in %s: Only binary PPM files are supported.\n", filename.c_str());
-		exit(1);
-	}
- 
-	line[0] = '#';
-	while (line[0] == '#' || line[0] == 10 || line[0] == 13){
-		fgets(line, 200, f); 
-	}
-	sscanf(line, "%d %d", &width, &height);
-
-	fgets(line, 200, f); 
-	sscanf(line, "%d", &imax);
-
-	if (width <= 0 || height <= 0)
-	{
-		fprintf(stderr, "Invalid image size in input file %s.\n", filename.c_str());
-		exit(1);
+		reportError("Can't open input file %s.\n", filename.c_str());
+		throw RunError();
 	}
+	readHeader(f, filename.c_str(), type, &width, &height, &imax);
 	fclose(f);
 	
 	return std::make_pair(height, width);
@@ -311,7 +737,7 @@ std::pair<int, int> readHeightAndWidth(const std::string filename){
 
 //Creates a copy of the image img, resized to the given height or width, whichever is a greater percent enlargement,
 //then crops to match the exact dimensions. Returns the copy and only deletes the original if delete_original is true
-Image resize_and_crop(Image img, const int OUTPUT_HEIGHT, const int OUTPUT_WIDTH, bool delete_original)
+Image resize_and_crop(Image img, const int OUTPUT_HEIGHT, const int OUTPUT_WIDTH, bool delete_original, ThreadPool *pool)
 {
 	if(img.height == OUTPUT_HEIGHT && img.width == OUTPUT_WIDTH){
 		return img;
@@ -333,36 +759,26 @@ Image resize_and_crop(Image img, const int OUTPUT_HEIGHT, const int OUTPUT_WIDTH
 			++resize_width; //this seems to never happen
 		}
 	}
-	Image resized_image = resampleBicubic(img, resize_height, resize_width);
-
-	//2. Cropping.
-	Image cropped_image = createImage(OUTPUT_HEIGHT, OUTPUT_WIDTH);
-	int i_first, i_last, j_first, j_last;
-	if(resized_image.height == OUTPUT_HEIGHT){
+	//2. Cropping. Only the centered window of the resized image is ever resampled, straight into the result.
+	int i_first, j_first;
+	if(resize_height == OUTPUT_HEIGHT){
 		i_first = 0;
-		i_last = OUTPUT_HEIGHT - 1;
-		j_first = floor((resized_image.width / 2.0) - (OUTPUT_WIDTH / 2.0));
-		j_last = j_first + OUTPUT_WIDTH - 1;
+		j_first = floor((resize_width / 2.0) - (OUTPUT_WIDTH / 2.0));
 	}
-	else if (resized_image.width == OUTPUT_WIDTH){
-		i_first = floor((resized_image.height / 2.0) - (OUTPUT_HEIGHT / 2.0));
-		i_last = i_first + OUTPUT_HEIGHT - 1;
+	else if (resize_width == OUTPUT_WIDTH){
+		i_first = floor((resize_height / 2.0) - (OUTPUT_HEIGHT / 2.0));
 		j_first = 0;
-		j_last = OUTPUT_WIDTH - 1;
 	}
 	else{
 		std::cout << "LOGIC ERROR: Neither height nor width is a match after resizing in resize_and_crop()\n";
-		deleteImage(resized_image);
-		deleteImage(img);
-		exit(1);
-	}
-	for(int i = i_first; i <= i_last; ++i){
-		for(int j = j_first; j <= j_last; ++j){
-			copyPixel(&cropped_image.map[i - i_first][j - j_first], &resized_image.map[i][j]);
+		if(delete_original){
+			deleteImage(img);
 		}
+		throw RunError();
 	}
+	Image cropped_image = createImageUninitialized(OUTPUT_HEIGHT, OUTPUT_WIDTH);
+	resampleBicubicWindow(img, resize_height, resize_width, i_first, j_first, cropped_image, pool);
 
-	deleteImage(resized_image);
 	if(delete_original){
 		deleteImage(img);
 	}
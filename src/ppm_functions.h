@@ -1,9 +1,13 @@
 #ifndef PPM_FUNCTIONS
 #define PPM_FUNCTIONS
 
+#include <stdio.h>
 #include <string>
 #include <utility>
 #include <iostream>
+#include <atomic>
+
+#include "threadpool.h"
 
 // ppm_functions.h
 // Marc Pomplun
@@ -22,6 +26,19 @@
 // Changed the C file to a C++ file (although the bulk of the code is still C style)
 // Renamed from NETPBM to PPM_Functions
 // Added resize_and_crop function
+// Added alignedMalloc and alignedFree
+// Images are now a single aligned allocation with the rows stored back to back (see Image below)
+// Added createImageUninitialized
+// readImage maps P6 files with a maximum value of 255 straight into memory instead of copying them (not on Windows)
+// Added readImageRows and the beginImageFile/writeImageRows/endImageFile functions for working on a few rows at a time
+// File positions and sizes are 64 bit throughout
+// resampleBicubic is separable, with weight tables cached per size, and can use a ThreadPool
+// Added readImageHeader, and versions of readImage and readImageRows that skip straight to a known raster
+// Added running totals of the bytes read and written, for the run report
+// Errors are printed through std::cerr and thrown as a RunError (see utility.h) instead of exiting, for the job server
+// tell64 and seek64 are public, for reading the container files
+// Added ScopedImage, and the readers close their files (and delete their images) before throwing an error
+// The running totals of bytes read and written can be kept per thread (see ByteTotals), for the job server
 
 #define SQR(x) ((x)*(x))
 #define PI 3.14159265358979323846
@@ -43,39 +60,146 @@ typedef struct
 
 // Notice that the pixel map uses "matrix notation," i.e., map[i][j] refers to
 // the pixel in row i and column j (counting rows and columns starts with 0).
+// The row pointers and the pixels share one aligned allocation. The pixels are stored row after row
+// starting at data, so map[i] == data + i*width, which is exactly the layout of a binary PPM raster.
+// Images returned by readImage may instead be a view of a memory-mapped file, in which case mapping is
+// the start of that mapping (and data points into it). For all other images, mapping is NULL.
 typedef struct
 {
 	int height, width;
 	Pixel **map;
+	Pixel *data;
+	void *mapping;
+	size_t mapping_size;
 } Image;
 
+// Memory is aligned to this many bytes (one cache line) by alignedMalloc.
+#define PPM_ALIGNMENT 64
+
 // The supported file type, using 24 bits per pixel
 typedef enum format {PPM} Format;
 
+// What the header of an image file says, and where its raster starts.
+typedef struct
+{
+	int height, width, imax;
+	bool p6; // False for any other kind of file, which is read the same way but never memory-mapped.
+	long long raster_offset;
+} ImageHeader;
+
 // Create a new image of the given size and fill it with white pixels.
 // When you don't need the image anymore, don't forget to free its memory using deleteImage.
 Image createImage(int height, int width);
 
+// Create a new image of the given size without setting its pixels to anything.
+// Use this for images that are about to be completely overwritten anyway.
+Image createImageUninitialized(int height, int width);
+
 // Delete a previously created image and free its allocated memory on the heap.
 void deleteImage(Image img);
 
+// Holds an image and deletes it when it goes out of scope, so that it isn't leaked when an error is thrown.
+// It can be passed anywhere an Image can. reset deletes the image early (or swaps in another one), and release
+// hands it back to be deleted some other way.
+class ScopedImage
+{
+public:
+	ScopedImage() : img() {}
+	explicit ScopedImage(Image img) : img(img) {}
+	~ScopedImage() { reset(); }
+	ScopedImage(const ScopedImage &) = delete;
+	ScopedImage &operator=(const ScopedImage &) = delete;
+
+	const Image &get() const { return img; }
+	operator const Image &() const { return img; }
+	bool held() const { return img.map != NULL; }
+	// replacement may be the very image that's held (resize_and_crop returns its input if it's already the right size).
+	void reset(Image replacement = Image())
+	{
+		if (img.map != NULL && img.map != replacement.map)
+			deleteImage(img);
+		img = replacement;
+	}
+	Image release()
+	{
+		Image released = img;
+		img = Image();
+		return released;
+	}
+
+private:
+	Image img;
+};
+
 // Read an image from a file and allocate the required heap memory for it.
 // Notice that only PPM files are supported. Regardless of the
 // file type, all fields r, g, b, and i are filled in, with values from 0 to 255.
+// P6 files with a maximum value of 255 are memory-mapped rather than copied where the OS allows it.
+// Either way, the result is released with deleteImage.
 Image readImage(const char *filename);
 Image readImage(const std::string filename);
 
+// Read just the header of an image file (and find where its raster starts).
+ImageHeader readImageHeader(const std::string filename);
+
+// Versions of readImage and readImageRows for files whose headers have already been read with readImageHeader.
+// They don't read the header again, but go straight to the raster.
+Image readImage(const std::string filename, const ImageHeader &header);
+
+// Read only num_rows rows of an image, starting with row first_row, by seeking straight to them.
+// The result is a num_rows by width image, released with deleteImage as usual.
+Image readImageRows(const char *filename, int first_row, int num_rows);
+Image readImageRows(const std::string filename, int first_row, int num_rows);
+Image readImageRows(const std::string filename, const ImageHeader &header, int first_row, int num_rows);
+
 // Write an image to a file. The file format (binary PBM, PGM, or PPM) is automatically
 // chosen based on the given file name. For PBM and PGM files, only the intensity
 // (i) information is used, and for PPM files, only r, g, and b are relevant.
 void writeImage(Image img, const char *filename);
 void writeImage(Image img, const std::string filename);
 
+// Write an image a few rows at a time: beginImageFile creates the file and writes the header for the whole image,
+// each call to writeImageRows appends all the rows of an image (which must be as wide as the whole image),
+// and endImageFile closes the file. Together, the rows written must add up to the height given to beginImageFile.
+FILE *beginImageFile(const char *filename, int height, int width);
+FILE *beginImageFile(const std::string filename, int height, int width);
+void writeImageRows(FILE *f, Image rows);
+void endImageFile(FILE *f, const char *filename);
+void endImageFile(FILE *f, const std::string filename);
+
 // Set color for pixel (vPos, hPos) in image img.
 // If r, g, b, or i are set to NO_CHANGE, the corresponding color channels are left unchanged in img.
 // If they are set to INVERT, the corresponding channels are inverted, i.e., set to 255 minus their original value
 void setPixel(Image img, int vPos, int hPos, int r, int g, int b);
 
+// Running totals of the bytes of files read and written, for the run report. The functions here count what they
+// read and write themselves, and so should anything else in the program that reads or writes big files.
+// These may be called from any thread. Each thread counts into the totals it was given with countBytesInto, or into
+// the program's own if it wasn't given any, so that jobs running at the same time can each keep their own totals.
+// (The ThreadPool and FramePipeline threads count into the totals of the thread that gave them the work.)
+class ByteTotals
+{
+public:
+	ByteTotals() : read(0), written(0) {}
+	std::atomic<unsigned long long> read, written;
+};
+void countBytesRead(unsigned long long bytes);
+void countBytesWritten(unsigned long long bytes);
+unsigned long long totalBytesRead();
+unsigned long long totalBytesWritten();
+// Have this thread count into totals (NULL for the program's own). Returns the totals it counted into before.
+ByteTotals *countBytesInto(ByteTotals *totals);
+ByteTotals *currentByteTotals();
+
+// Allocate size bytes starting on a PPM_ALIGNMENT boundary. Returns NULL if the allocation fails.
+// Memory from alignedMalloc must be released with alignedFree, never with free.
+void *alignedMalloc(size_t size);
+void alignedFree(void *ptr);
+
+// ftell and fseek with 64 bit positions on every platform (fseeko and ftello don't exist under MSVC).
+long long tell64(FILE *f);
+int seek64(FILE *f, long long offset, int origin = SEEK_SET);
+
 //Copy a Pixel
 void copyPixel(Pixel* to, Pixel from);
 void copyPixel(Pixel* to, Pixel* from);
@@ -83,13 +207,16 @@ void copyPixel(Pixel* to, Pixel* from);
 // Helper function for resampleBicubic
 double c(double s, int n);
 // Rescale a color image using bicubic interpolation so that the new image size is vTarget by hTarget pixels.
-Image resampleBicubic(Image inImage, int vTarget, int hTarget);
+// The rows of the result are spread over the pool's threads if a pool is given. This may be called from any thread.
+Image resampleBicubic(Image inImage, int vTarget, int hTarget, ThreadPool *pool = NULL);
 
 //Read in the height and width information only and return it in a pair, with height first, width second.
 std::pair<int, int> readHeightAndWidth(const std::string filename);
 
 //Creates a copy of the image img, resized to the given height or width, whichever is a greater percent enlargement,
 //then crops to match the exact dimensions. Returns the copy and only deletes the original if delete_original is true
-Image resize_and_crop(Image img, const int OUTPUT_HEIGHT, const int OUTPUT_WIDTH, bool delete_original);
+//Only the part of the resized image that survives the cropping is actually resampled, straight into the copy.
+//The resampling is spread over the pool's threads if a pool is given.
+Image resize_and_crop(Image img, const int OUTPUT_HEIGHT, const int OUTPUT_WIDTH, bool delete_original, ThreadPool *pool = NULL);
 
 #endif // PPM_FUNCTIONS
\ No newline at end of file
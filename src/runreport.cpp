@@ -0,0 +1,246 @@
+// LeastAverageImage
+// Andrew Eckel
+// runreport.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#include "runreport.h"
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string.h>
+
+#include "ppm_functions.h"
+
+#ifdef _WIN32
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+static const char *PHASE_NAMES[RunReport::NUM_PHASES] = { "header_scan", "averaging", "differentiating", "output" };
+
+RunReport::RunReport(bool tracing)
+{
+	started = std::chrono::steady_clock::now();
+	started_cpu = cpuSeconds();
+	memset(phases, 0, sizeof(phases));
+	tracing_enabled = tracing;
+}
+
+double RunReport::now() const
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+}
+
+void RunReport::begin(Phase phase)
+{
+	PhaseTotals &p = phases[phase];
+	p.began_wall = now();
+	p.began_cpu = cpuSeconds();
+	p.began_read = totalBytesRead();
+	p.began_written = totalBytesWritten();
+	p.running = true;
+}
+
+void RunReport::end(Phase phase)
+{
+	PhaseTotals &p = phases[phase];
+	if(!p.running){
+		return;
+	}
+	double wall = now();
+	p.wall_seconds += wall - p.began_wall;
+	p.cpu_seconds += cpuSeconds() - p.began_cpu;
+	p.bytes_read += totalBytesRead() - p.began_read;
+	p.bytes_written += totalBytesWritten() - p.began_written;
+	p.running = false;
+	if(tracing_enabled){
+		Event event = { PHASE_NAMES[phase], -1, threadNumber(), p.began_wall * 1e6, (wall - p.began_wall) * 1e6 };
+		std::lock_guard<std::mutex> lock(events_mutex);
+		events.push_back(event);
+	}
+}
+
+void RunReport::addPixels(Phase phase, double pixels)
+{
+	phases[phase].pixels += pixels;
+}
+
+RunReport::Span::Span(RunReport &report, const char *name, int frame) : report(report), name(name), frame(frame)
+{
+	start = report.tracing_enabled ? report.now() : 0.0;
+}
+
+RunReport::Span::~Span()
+{
+	if(!report.tracing_enabled){
+		return;
+	}
+	Event event = { name, frame, report.threadNumber(), start * 1e6, (report.now() - start) * 1e6 };
+	std::lock_guard<std::mutex> lock(report.events_mutex);
+	report.events.push_back(event);
+}
+
+//Threads are numbered in the order they first record something, starting with 1, which is easier to read than
+//whatever the OS calls them.
+int RunReport::threadNumber()
+{
+	std::lock_guard<std::mutex> lock(events_mutex);
+	std::map<std::thread::id, int>::iterator found = thread_numbers.find(std::this_thread::get_id());
+	if(found != thread_numbers.end()){
+		return found->second;
+	}
+	int number = (int) thread_numbers.size() + 1;
+	thread_numbers[std::this_thread::get_id()] = number;
+	return number;
+}
+
+void RunReport::measureFunction(const std::string &name, int height, int width, const std::function<void(int)> &scoreRow)
+{
+	//Enough passes over the rows to take a noticeable amount of time, but no more.
+	int passes = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	double seconds;
+	do{
+		for(int i = 0; i < height; ++i){
+			scoreRow(i);
+		}
+		++passes;
+		seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	} while(seconds < 0.05 && passes < 1000);
+	function_speeds.push_back(std::make_pair(name, (double) height * width * passes / 1e6 / std::max(seconds, 1e-9)));
+}
+
+double RunReport::cpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if(!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)){
+		return 0.0;
+	}
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return (k.QuadPart + u.QuadPart) * 1e-7; //FILETIMEs count 100 nanosecond intervals.
+#else
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0){
+		return 0.0;
+	}
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+#endif
+}
+
+unsigned long long RunReport::peakResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))){
+		return 0;
+	}
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0){
+		return 0;
+	}
+#ifdef __APPLE__
+	return (unsigned long long) usage.ru_maxrss; //In bytes on macOS...
+#else
+	return (unsigned long long) usage.ru_maxrss * 1024; //...and in kilobytes everywhere else.
+#endif
+#endif
+}
+
+static std::string jsonString(const std::string &s)
+{
+	std::string quoted = "\"";
+	for(size_t c = 0; c < s.size(); ++c){
+		if(s[c] == '"' || s[c] == '\\'){
+			quoted += '\\';
+		}
+		if((unsigned char) s[c] >= 0x20){
+			quoted += s[c];
+		}
+	}
+	return quoted + "\"";
+}
+
+bool RunReport::write(const std::string &filename, const std::string &tag, int height, int width, int frames, int threads,
+                      const std::string &instruction_set)
+{
+	const double total_wall = now();
+	const double total_cpu = cpuSeconds() - started_cpu;
+	const unsigned long long peak = peakResidentBytes();
+
+	std::cout << "\nPhase               Wall (s)   CPU (s)   Read (MB)  Written (MB)   MPix/s" << std::endl;
+	for(int phase = 0; phase < NUM_PHASES; ++phase){
+		const PhaseTotals &p = phases[phase];
+		std::cout << std::left << std::setw(16) << PHASE_NAMES[phase] << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(12) << p.wall_seconds << std::setw(10) << p.cpu_seconds << std::setw(12) << p.bytes_read / 1e6
+			<< std::setw(14) << p.bytes_written / 1e6 << std::setw(9) << std::setprecision(1)
+			<< ((p.wall_seconds > 0.0) ? p.pixels / 1e6 / p.wall_seconds : 0.0) << std::endl;
+	}
+	for(size_t f = 0; f < function_speeds.size(); ++f){
+		std::cout << "Difference function " << function_speeds[f].first << ": " << std::setprecision(1)
+			<< function_speeds[f].second << " MPix/s (one thread)" << std::endl;
+	}
+	std::cout << "Total: " << std::setprecision(2) << total_wall << " s wall, " << total_cpu << " s CPU. Peak memory: "
+		<< peak / (1024 * 1024) << " MB." << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+	std::cout << std::setprecision(6);
+
+	std::ofstream json(filename);
+	if(!json){
+		return false;
+	}
+	json << std::setprecision(9);
+	json << "{\n  \"tag\": " << jsonString(tag) << ",\n  \"height\": " << height << ",\n  \"width\": " << width
+		<< ",\n  \"frames\": " << frames << ",\n  \"threads\": " << threads << ",\n  \"instruction_set\": "
+		<< jsonString(instruction_set) << ",\n  \"wall_seconds\": " << total_wall << ",\n  \"cpu_seconds\": " << total_cpu
+		<< ",\n  \"peak_resident_bytes\": " << peak << ",\n  \"phases\": [\n";
+	for(int phase = 0; phase < NUM_PHASES; ++phase){
+		const PhaseTotals &p = phases[phase];
+		json << "    {\"name\": \"" << PHASE_NAMES[phase] << "\", \"wall_seconds\": " << p.wall_seconds << ", \"cpu_seconds\": "
+			<< p.cpu_seconds << ", \"bytes_read\": " << p.bytes_read << ", \"bytes_written\": " << p.bytes_written
+			<< ", \"megapixels\": " << p.pixels / 1e6 << ", \"mpix_per_s\": "
+			<< ((p.wall_seconds > 0.0) ? p.pixels / 1e6 / p.wall_seconds : 0.0) << "}" << ((phase + 1 < NUM_PHASES) ? "," : "") << "\n";
+	}
+	json << "  ],\n  \"difference_functions\": [\n";
+	for(size_t f = 0; f < function_speeds.size(); ++f){
+		json << "    {\"name\": " << jsonString(function_speeds[f].first) << ", \"mpix_per_s\": " << function_speeds[f].second
+			<< "}" << ((f + 1 < function_speeds.size()) ? "," : "") << "\n";
+	}
+	json << "  ]\n}\n";
+	return (bool) json;
+}
+
+bool RunReport::writeTrace(const std::string &filename)
+{
+	std::ofstream json(filename);
+	if(!json){
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(events_mutex);
+	json << std::fixed << std::setprecision(1);
+	json << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+	for(size_t e = 0; e < events.size(); ++e){
+		const Event &event = events[e];
+		json << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+			<< ", \"ts\": " << event.start << ", \"dur\": " << event.duration;
+		if(event.frame >= 0){
+			json << ", \"args\": {\"frame\": " << event.frame + 1 << "}";
+		}
+		json << "}" << ((e + 1 < events.size()) ? "," : "") << "\n";
+	}
+	json << "]}\n";
+	return (bool) json;
+}
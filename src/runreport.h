@@ -0,0 +1,99 @@
+// LeastAverageImage
+// Andrew Eckel
+// runreport.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef RUNREPORT_H
+#define RUNREPORT_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <functional>
+
+//Where a run's time goes. Each phase adds up the wall clock and CPU time spent in it, the bytes of files read and
+//written meanwhile (see totalBytesRead in ppm_functions.h), and the pixels it got through, across however many times
+//it's begun and ended (in tiled mode, once per strip). At the end, these are written to a JSON report, along with the
+//speed of each difference function and the peak memory use.
+//Optionally, a timeline of every frame's decoding and processing is kept too, and written in the Trace Event format
+//that chrome://tracing and ui.perfetto.dev open.
+class RunReport
+{
+public:
+	enum Phase { HEADER_SCAN, AVERAGING, DIFFERENTIATING, OUTPUT, NUM_PHASES };
+
+	//With tracing false, spans are not recorded.
+	explicit RunReport(bool tracing);
+
+	void begin(Phase phase);
+	void end(Phase phase);
+	void addPixels(Phase phase, double pixels);
+
+	//A span of time on the timeline, from its construction to its destruction, on the thread that made it.
+	//frame is shown with it, unless it's negative. Does nothing if the report isn't tracing.
+	class Span
+	{
+	public:
+		Span(RunReport &report, const char *name, int frame);
+		~Span();
+	private:
+		RunReport &report;
+		const char *name;
+		int frame;
+		double start;
+	};
+	bool tracing() const { return tracing_enabled; }
+
+	//Time scoreRow(i) for rows 0 to height - 1 (of width pixels), on this thread, a few times over, and report the
+	//speed under name. This is how each difference function is measured, since the run itself computes them together.
+	void measureFunction(const std::string &name, int height, int width, const std::function<void(int)> &scoreRow);
+
+	//Print a summary of the phases, and write the JSON report. Returns false if it couldn't be written.
+	bool write(const std::string &filename, const std::string &tag, int height, int width, int frames, int threads,
+	           const std::string &instruction_set);
+	//Write the timeline. Returns false if it couldn't be written.
+	bool writeTrace(const std::string &filename);
+
+	//The process's total CPU time so far (every thread, user and system), and its peak resident memory.
+	static double cpuSeconds();
+	static unsigned long long peakResidentBytes();
+
+private:
+	typedef struct
+	{
+		double wall_seconds, cpu_seconds;
+		unsigned long long bytes_read, bytes_written;
+		double pixels;
+		//While the phase is running: when (and with how much CPU time and I/O so far) it began.
+		double began_wall, began_cpu;
+		unsigned long long began_read, began_written;
+		bool running;
+	} PhaseTotals;
+
+	typedef struct
+	{
+		const char *name;
+		int frame, thread;
+		double start, duration; //In microseconds since the report was made.
+	} Event;
+
+	double now() const;
+	int threadNumber();
+
+	std::chrono::steady_clock::time_point started;
+	double started_cpu;
+	PhaseTotals phases[NUM_PHASES];
+	std::vector<std::pair<std::string, double> > function_speeds; //Megapixels per second.
+
+	bool tracing_enabled;
+	std::mutex events_mutex;
+	std::vector<Event> events;
+	std::map<std::thread::id, int> thread_numbers;
+};
+
+#endif //RUNREPORT_H
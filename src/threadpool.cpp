@@ -0,0 +1,156 @@
+// LeastAverageImage
+// Andrew Eckel
+// threadpool.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#include "threadpool.h"
+#include "ppm_functions.h"
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <exception>
+
+//Shared between the caller of parallelForBands and the workers helping it.
+//Held by shared_ptr because a worker may pick up its helper task after the caller has already returned.
+struct BandJob
+{
+	std::function<void(int, int)> task;
+	int begin, end, num_bands;
+	std::atomic<int> next_band;
+	int bands_finished;
+	std::exception_ptr error; //The first thing a band threw, if anything. The caller rethrows it.
+	std::mutex finished_mutex;
+	std::condition_variable finished_cv;
+};
+
+//Grab bands one at a time until there are none left.
+static void runBands(BandJob &job)
+{
+	int rows = job.end - job.begin;
+	int band;
+	while((band = job.next_band.fetch_add(1)) < job.num_bands){
+		//Spread the leftover rows over the first bands, so band sizes differ by at most one row.
+		int band_begin = job.begin + (int)((long long) rows * band / job.num_bands);
+		int band_end = job.begin + (int)((long long) rows * (band + 1) / job.num_bands);
+		std::exception_ptr error;
+		try{
+			job.task(band_begin, band_end);
+		} catch(...){
+			error = std::current_exception();
+		}
+
+		std::lock_guard<std::mutex> lock(job.finished_mutex);
+		if(error && !job.error){
+			job.error = error;
+		}
+		++job.bands_finished;
+		if(job.bands_finished == job.num_bands){
+			job.finished_cv.notify_all();
+		}
+	}
+}
+
+ThreadPool::ThreadPool(unsigned int num_threads)
+{
+	stopping = false;
+	if(num_threads == 0){
+		num_threads = defaultThreadCount();
+	}
+	for(unsigned int t = 1; t < num_threads; ++t){
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(tasks_mutex);
+		stopping = true;
+	}
+	tasks_cv.notify_all();
+	for(size_t t = 0; t < workers.size(); ++t){
+		workers[t].join();
+	}
+}
+
+unsigned int ThreadPool::size() const
+{
+	return workers.size() + 1;
+}
+
+void ThreadPool::enqueue(const std::function<void()> &task)
+{
+	if(workers.empty()){
+		task();
+		return;
+	}
+	//The bytes the task reads and writes count for whoever queued it.
+	ByteTotals *totals = currentByteTotals();
+	{
+		std::lock_guard<std::mutex> lock(tasks_mutex);
+		tasks.push_back([task, totals](){
+			ByteTotals *previous = countBytesInto(totals);
+			task();
+			countBytesInto(previous);
+		});
+	}
+	tasks_cv.notify_one();
+}
+
+void ThreadPool::parallelForBands(int begin, int end, const std::function<void(int, int)> &task)
+{
+	if(end <= begin){
+		return;
+	}
+	if(workers.empty()){
+		task(begin, end);
+		return;
+	}
+
+	std::shared_ptr<BandJob> job = std::make_shared<BandJob>();
+	job->task = task;
+	job->begin = begin;
+	job->end = end;
+	//A few bands per thread evens out the load when some rows turn out to be slower than others.
+	job->num_bands = std::min(end - begin, (int) size() * 4);
+	job->next_band = 0;
+	job->bands_finished = 0;
+
+	int num_helpers = std::min((int) workers.size(), job->num_bands - 1);
+	for(int h = 0; h < num_helpers; ++h){
+		enqueue([job]() { runBands(*job); });
+	}
+	runBands(*job);
+
+	std::unique_lock<std::mutex> lock(job->finished_mutex);
+	job->finished_cv.wait(lock, [&job]() { return job->bands_finished == job->num_bands; });
+	if(job->error){
+		std::rethrow_exception(job->error);
+	}
+}
+
+unsigned int ThreadPool::defaultThreadCount()
+{
+	unsigned int n = std::thread::hardware_concurrency();
+	return (n == 0) ? 1 : n;
+}
+
+void ThreadPool::workerLoop()
+{
+	while(true){
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(tasks_mutex);
+			tasks_cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if(stopping && tasks.empty()){
+				return;
+			}
+			task = tasks.front();
+			tasks.pop_front();
+		}
+		task();
+	}
+}
@@ -0,0 +1,53 @@
+// LeastAverageImage
+// Andrew Eckel
+// threadpool.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//A fixed set of worker threads that run queued tasks.
+//The thread that owns the pool counts as one of its threads: a pool of size n starts n - 1 workers,
+//and parallelForBands() has the calling thread work on bands too. So a pool of size 1 runs everything
+//inline, exactly like the single-threaded program did.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned int num_threads);
+	~ThreadPool();
+
+	//Total number of threads doing work, including the caller.
+	unsigned int size() const;
+
+	//Queue a task to be run by one of the workers. (With no workers, the task runs immediately.)
+	void enqueue(const std::function<void()> &task);
+
+	//Split the rows [begin, end) into horizontal bands and call task(band_begin, band_end) once per band,
+	//spread over all the threads. Returns once every band is finished.
+	//Bands never overlap, so the task may freely write to anything that belongs to its own rows.
+	//If a band throws, the rest still run, and then the first exception is rethrown here.
+	void parallelForBands(int begin, int end, const std::function<void(int, int)> &task);
+
+	//The number of threads to use when the settings file says threads=0.
+	static unsigned int defaultThreadCount();
+
+private:
+	void workerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()> > tasks;
+	std::mutex tasks_mutex;
+	std::condition_variable tasks_cv;
+	bool stopping;
+};
+
+#endif //THREADPOOL_H
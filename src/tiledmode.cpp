@@ -0,0 +1,200 @@
+// LeastAverageImage
+// Andrew Eckel
+// tiledmode.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#include "tiledmode.h"
+#include "utility.h"
+
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+//Output files that are written a strip at a time, so they're all open until the end. If there's an error before
+//they're finished, whichever are still open are closed and removed when this goes out of scope.
+class StripFiles
+{
+public:
+	StripFiles() {}
+	~StripFiles()
+	{
+		for(size_t f = 0; f < files.size(); ++f){
+			if(files[f] != NULL){
+				fclose(files[f]);
+				remove(filenames[f].c_str());
+			}
+		}
+	}
+	StripFiles(const StripFiles &) = delete;
+	StripFiles &operator=(const StripFiles &) = delete;
+
+	void open(const std::string &filename, int height, int width)
+	{
+		files.push_back(beginImageFile(filename, height, width));
+		filenames.push_back(filename);
+	}
+	//Close every file, now that all of its rows have been written.
+	void finish()
+	{
+		for(size_t f = 0; f < files.size(); ++f){
+			FILE *file = files[f];
+			files[f] = NULL;
+			endImageFile(file, filenames[f]);
+		}
+	}
+	const std::vector<FILE *> &all() const { return files; }
+	size_t size() const { return files.size(); }
+	FILE *operator[](size_t f) const { return files[f]; }
+
+private:
+	std::vector<FILE *> files;
+	std::vector<std::string> filenames;
+};
+
+void processInStrips(const TiledSettings &settings, std::vector<DifferenceRecord> &drs,
+                     DifferenceFunctions::FusedRowFunction scoreRow, const std::vector<OutputJob> &jobs, ThreadPool &pool)
+{
+	const int NUM_IMAGES = settings.inputFilenames.size();
+	const int width = settings.output_width;
+
+	//Find out which frames can be read a strip at a time.
+	std::vector<bool> rightSize(NUM_IMAGES);
+	int num_resized = 0;
+	for(int x = 0; x < NUM_IMAGES; ++x){
+		std::pair<int, int> dimensions = (settings.container != NULL) ? settings.container->heightAndWidth(x)
+			: (settings.manifest != NULL) ? settings.manifest->heightAndWidth(x) : readHeightAndWidth(settings.inputFilenames[x]);
+		rightSize[x] = (dimensions.first == settings.output_height && dimensions.second == width);
+		if(!rightSize[x]){
+			if(!settings.allow_resizing_and_cropping){
+				std::cerr << "ERROR: Image  \"" << settings.inputFilenames[x] << "\" dimensions do not match those of image \"" << settings.inputFilenames[0] << "\".\n";
+				throw RunError();
+			}
+			++num_resized;
+		}
+	}
+	if(num_resized > 0){
+		std::cout << "WARNING: " << num_resized << " of " << NUM_IMAGES << " frames need resizing, so they will be read whole "
+			<< "(and resized) once for every strip.\n";
+	}
+	if(settings.skip_averaging_phase){
+		std::pair<int, int> dimensions = readHeightAndWidth(settings.pre_averaged_filename);
+		if(dimensions.first != settings.output_height || dimensions.second != width){
+			std::cerr << "ERROR: Pre-averaged image dimensions do not match expected output dimensions.\n";
+			throw RunError();
+		}
+	}
+
+	//Every output file is written a strip at a time, so they are all open until the end.
+	StripFiles averageFiles;
+	if(!settings.skip_averaging_phase){
+		for(size_t a = 0; a < settings.average_filenames.size(); ++a){
+			averageFiles.open(settings.average_filenames[a], settings.output_height, width);
+		}
+	}
+	StripFiles outputFiles;
+	for(size_t w = 0; w < jobs.size(); ++w){
+		outputFiles.open(jobs[w].path + jobs[w].filename, settings.output_height, width);
+	}
+
+	std::vector<int> allFrames;
+	for(int x = 0; x < NUM_IMAGES; ++x){
+		allFrames.push_back(x);
+	}
+	RunReport &report = *settings.report;
+	const int num_strips = (settings.output_height + settings.strip_rows - 1) / settings.strip_rows;
+	bool printed_all_pixels_equal_warning = false;
+
+	for(int strip = 0; strip < num_strips; ++strip){
+		const int first_row = strip * settings.strip_rows;
+		const int strip_height = std::min(settings.strip_rows, settings.output_height - first_row);
+		std::cout << "\nStrip " << strip + 1 << " of " << num_strips << ": rows " << first_row << " to "
+			<< first_row + strip_height - 1 << "." << std::endl;
+
+		//Reads this strip's rows of frame x. This runs on the decoder threads of a FramePipeline.
+		FramePipeline::FrameLoader loadStrip = [&settings, &rightSize, first_row, strip_height, width](int x){
+			if(rightSize[x] && settings.container != NULL){
+				return settings.container->readFrameRows(x, first_row, strip_height);
+			}
+			if(rightSize[x] && settings.manifest != NULL){
+				return readImageRows(settings.inputFilenames[x], settings.manifest->header(x), first_row, strip_height);
+			}
+			if(rightSize[x]){
+				return readImageRows(settings.inputFilenames[x], first_row, strip_height);
+			}
+			ScopedImage whole(settings.loadWholeFrame(x));
+			Image rows = createImageUninitialized(strip_height, width);
+			memcpy(rows.data, whole.get().map[first_row], sizeof(Pixel) * (size_t) strip_height * width);
+			return rows;
+		};
+
+		//First pass, for this strip: Sum all the values in the input files.
+		report.begin(RunReport::AVERAGING);
+		ScopedImage meanAverageRows;
+		if(settings.skip_averaging_phase){
+			meanAverageRows.reset(readImageRows(settings.pre_averaged_filename, first_row, strip_height));
+		}
+		else{
+			AverageAccumulator totals(strip_height, width);
+			FramePipeline averagingPipeline(settings.framesToAverage, loadStrip, settings.decoder_threads, settings.prefetch_depth);
+			while(!averagingPipeline.done()){
+				int x;
+				ScopedImage img(averagingPipeline.next(&x));
+				{
+					RunReport::Span span(report, "average", x);
+					totals.add(img, pool);
+				}
+				report.addPixels(RunReport::AVERAGING, (double) strip_height * width);
+			}
+			meanAverageRows.reset(totals.mean(settings.framesToAverage.size(), pool));
+			for(size_t a = 0; a < averageFiles.size(); ++a){
+				writeImageRows(averageFiles[a], meanAverageRows);
+			}
+		}
+		report.end(RunReport::AVERAGING);
+		std::cout << "Averaged strip " << strip + 1 << " of " << num_strips << "." << std::endl;
+
+		//Second pass, for this strip: Find the most different.
+		report.begin(RunReport::DIFFERENTIATING);
+		for(size_t drs_index = 0; drs_index < drs.size(); ++drs_index){
+			allocateRankings(drs[drs_index], strip_height, width);
+		}
+		FramePipeline differentiatingPipeline(allFrames, loadStrip, settings.decoder_threads, settings.prefetch_depth);
+		while(!differentiatingPipeline.done()){
+			int x;
+			ScopedImage img(differentiatingPipeline.next(&x));
+			{
+				RunReport::Span span(report, "rank", x);
+				pool.parallelForBands(0, strip_height, [&](int band_begin, int band_end){
+					rankFrameRows(drs, scoreRow, meanAverageRows, img, band_begin, band_end, x);
+				});
+			}
+			report.addPixels(RunReport::DIFFERENTIATING, (double) strip_height * width);
+		}
+		pool.parallelForBands(0, strip_height, [&](int band_begin, int band_end){
+			for(size_t drs_index = 0; drs_index < drs.size(); ++drs_index){
+				drs[drs_index].rankings.finish(band_begin, band_end);
+			}
+		});
+		report.end(RunReport::DIFFERENTIATING);
+		std::cout << "Differentiated strip " << strip + 1 << " of " << num_strips << "." << std::endl;
+
+		report.begin(RunReport::OUTPUT);
+		renderAndAppendOutputRows(jobs, meanAverageRows, first_row, outputFiles.all(), pool, &printed_all_pixels_equal_warning);
+		report.addPixels(RunReport::OUTPUT, (double) jobs.size() * strip_height * width);
+		report.end(RunReport::OUTPUT);
+		for(size_t drs_index = 0; drs_index < drs.size(); ++drs_index){
+			drs[drs_index].rankings.release();
+		}
+		meanAverageRows.reset();
+	}
+
+	std::cout << std::endl;
+	averageFiles.finish();
+	outputFiles.finish();
+	for(size_t w = 0; w < jobs.size(); ++w){
+		std::cout << "Created file " << jobs[w].filename << std::endl;
+	}
+}
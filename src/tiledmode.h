@@ -0,0 +1,54 @@
+// LeastAverageImage
+// Andrew Eckel
+// tiledmode.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef TILEDMODE_H
+#define TILEDMODE_H
+
+#include <string>
+#include <vector>
+
+#include "ppm_functions.h"
+#include "differencefunctions.h"
+#include "differencerecord.h"
+#include "framepipeline.h"
+#include "outputrenderer.h"
+#include "threadpool.h"
+#include "averageaccumulator.h"
+#include "framecontainer.h"
+#include "inputmanifest.h"
+#include "runreport.h"
+
+//Everything processInStrips needs to know besides the difference records and output jobs.
+typedef struct
+{
+	std::vector<std::string> inputFilenames; //INCLUDES PATHS
+	FrameContainer *container; //If not NULL, the frames are read from here instead of inputFilenames.
+	const InputManifest *manifest; //If not NULL, the input files' headers are already known, from here.
+	int output_height, output_width;
+	int strip_rows;
+	//Frames that aren't already output_height by output_width have to be read whole and resized,
+	//once per strip, with this. Frames that are the right size are read a strip at a time.
+	bool allow_resizing_and_cropping;
+	FramePipeline::FrameLoader loadWholeFrame;
+	int decoder_threads, prefetch_depth;
+	bool skip_averaging_phase;
+	std::vector<int> framesToAverage; //All of them, unless the average is approximate.
+	std::string pre_averaged_filename; //INCLUDES PATH
+	std::vector<std::string> average_filenames; //INCLUDE PATHS. The average is saved to each of these, if any.
+	RunReport *report; //Each strip's share of each phase is added to this.
+} TiledSettings;
+
+//Tiled (out-of-core) mode: do the whole job one horizontal strip of strip_rows rows at a time.
+//For each strip, only those rows of each input file are read (by seeking straight to them), the average and
+//every record's rankings are kept for just those rows, and the strip's rows of every output file are rendered
+//and appended to it. So memory use depends on the width of the images and the strip height, not the full height.
+//The outputs are exactly the same as without tiling; the input files are just read once per strip (twice,
+//if the averaging phase isn't skipped).
+void processInStrips(const TiledSettings &settings, std::vector<DifferenceRecord> &drs,
+                     DifferenceFunctions::FusedRowFunction scoreRow, const std::vector<OutputJob> &jobs, ThreadPool &pool);
+
+#endif //TILEDMODE_H
@@ -7,6 +7,9 @@
 
 #include "utility.h"
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 std::string Utility::endWithSlash(std::string s) {
 	//If s ends with a slash, returns s.
 	//Otherwise, returns s + a slash.
@@ -150,4 +153,14 @@ std::string Utility::trim(std::string s){
 	}
 
 	return s.substr(i, j - i + 1);
-}
\ No newline at end of file
+}
+
+long long Utility::modificationNanoseconds(const struct stat &st){
+#if defined(_WIN32)
+	return 0;
+#elif defined(__APPLE__)
+	return (long long) st.st_mtimespec.tv_nsec;
+#else
+	return (long long) st.st_mtim.tv_nsec;
+#endif
+}
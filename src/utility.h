@@ -14,6 +14,8 @@
 #include <iomanip>
 #include <sstream>
 
+struct stat;
+
 class Utility
 {
 public:
@@ -27,6 +29,14 @@ public:
 	static std::string intToString(int x);
 	static std::string doubleToString(double x, int fixed_precision);
 	static std::string trim(std::string s);
+	//The part of a file's modification time after the whole seconds, where the platform keeps it (0 where it doesn't),
+	//so that a file rewritten within the same second is still noticed.
+	static long long modificationNanoseconds(const struct stat &st);
 };
 
+//Thrown, instead of ending the program, when something goes wrong that a run can't go on from, so that a job server
+//(see jobserver.h) can fail just that one job. The error has already been printed to std::cerr by then.
+//It's deliberately not a std::exception, so it goes straight past the catch blocks that fill in default settings.
+struct RunError {};
+
 #endif //UTILITY_H
@@ -0,0 +1,128 @@
+// LeastAverageImage
+// Andrew Eckel
+// warmcache.cpp
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#include "warmcache.h"
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "framecache.h"
+#include "utility.h"
+
+static Image copyImage(const Image &img)
+{
+	Image copy = createImageUninitialized(img.height, img.width);
+	memcpy(copy.data, img.data, sizeof(Pixel) * (size_t) img.height * img.width);
+	return copy;
+}
+
+WarmCache::WarmCache(size_t budget_bytes)
+{
+	this->budget_bytes = budget_bytes;
+	bytes_used = 0;
+}
+
+WarmCache::~WarmCache()
+{
+	for(std::map<std::string, Entry>::iterator e = entries.begin(); e != entries.end(); ++e){
+		deleteImage(e->second.img);
+	}
+}
+
+bool WarmCache::findAverage(const std::string &key, Image *img)
+{
+	return find("a" + key, img);
+}
+
+void WarmCache::storeAverage(const std::string &key, const Image &average)
+{
+	store("a" + key, average);
+}
+
+bool WarmCache::findFrame(const std::string &key, Image *img)
+{
+	return find("f" + key, img);
+}
+
+void WarmCache::storeFrame(const std::string &key, const Image &frame)
+{
+	store("f" + key, frame);
+}
+
+int WarmCache::averagesHeld()
+{
+	return count('a');
+}
+
+int WarmCache::framesHeld()
+{
+	return count('f');
+}
+
+size_t WarmCache::bytesUsed()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return bytes_used;
+}
+
+std::string WarmCache::fileStamp(const std::string &filename)
+{
+	struct stat st;
+	if(stat(filename.c_str(), &st) != 0){
+		return filename;
+	}
+	return filename + "|" + std::to_string((long long) st.st_size) + "|" + std::to_string((long long) st.st_mtime) + "."
+		+ std::to_string(Utility::modificationNanoseconds(st));
+}
+
+bool WarmCache::find(const std::string &key, Image *img)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::map<std::string, Entry>::iterator e = entries.find(key);
+	if(e == entries.end()){
+		return false;
+	}
+	recently_used.splice(recently_used.begin(), recently_used, e->second.recent);
+	*img = copyImage(e->second.img);
+	return true;
+}
+
+void WarmCache::store(const std::string &key, const Image &img)
+{
+	size_t size = FrameCache::imageBytes(img);
+	std::lock_guard<std::mutex> lock(mutex);
+	if(size > budget_bytes || entries.count(key) > 0){
+		return;
+	}
+	//Make room, starting with whatever was used longest ago.
+	while(bytes_used + size > budget_bytes){
+		std::map<std::string, Entry>::iterator oldest = entries.find(recently_used.back());
+		bytes_used -= FrameCache::imageBytes(oldest->second.img);
+		deleteImage(oldest->second.img);
+		entries.erase(oldest);
+		recently_used.pop_back();
+	}
+	recently_used.push_front(key);
+	Entry entry;
+	entry.img = copyImage(img);
+	entry.recent = recently_used.begin();
+	entries[key] = entry;
+	bytes_used += size;
+}
+
+int WarmCache::count(char kind)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	int n = 0;
+	for(std::map<std::string, Entry>::iterator e = entries.begin(); e != entries.end(); ++e){
+		if(e->first[0] == kind){
+			++n;
+		}
+	}
+	return n;
+}
@@ -0,0 +1,69 @@
+// LeastAverageImage
+// Andrew Eckel
+// warmcache.h
+
+// LeastAverageImage is released under the Simplified BSD License,
+// which is duplicated at the bottom of main.cpp
+
+#ifndef WARMCACHE_H
+#define WARMCACHE_H
+
+#include <string>
+#include <map>
+#include <list>
+#include <mutex>
+#include <stddef.h>
+
+#include "ppm_functions.h"
+
+//What the job server (see jobserver.h) keeps in memory from one job to the next: the averages it has made, and the
+//frames it has decoded (and resized), up to a budget. Once the budget is used up, whatever was used longest ago goes.
+//Images are copied in and out, so callers own their images and delete them as usual. Safe to use from any thread.
+//Keys are up to the caller, and should change whenever anything the image depends on does (see fileStamp).
+//Since whatever was used longest ago goes first, frames read in order are only worth storing if all of them fit:
+//otherwise each one pushes out one that's needed sooner, and none of them are ever found again.
+class WarmCache
+{
+public:
+	explicit WarmCache(size_t budget_bytes);
+	~WarmCache();
+	WarmCache(const WarmCache &) = delete;
+	WarmCache &operator=(const WarmCache &) = delete;
+
+	//If there's an average for key, copy it into img and return true.
+	bool findAverage(const std::string &key, Image *img);
+	//Keep a copy of average under key, if it fits in the budget.
+	void storeAverage(const std::string &key, const Image &average);
+
+	//The same, for frames.
+	bool findFrame(const std::string &key, Image *img);
+	void storeFrame(const std::string &key, const Image &frame);
+
+	size_t budget() const { return budget_bytes; }
+	int averagesHeld();
+	int framesHeld();
+	size_t bytesUsed();
+
+	//A string that changes whenever the file does: its name, size, and modification time (to the nanosecond, where the
+	//platform keeps it).
+	//If the file can't be found, just its name.
+	static std::string fileStamp(const std::string &filename);
+
+private:
+	typedef struct
+	{
+		Image img;
+		std::list<std::string>::iterator recent; //Where the key is in recently_used.
+	} Entry;
+
+	bool find(const std::string &key, Image *img);
+	void store(const std::string &key, const Image &img);
+	int count(char kind);
+
+	size_t budget_bytes, bytes_used;
+	std::map<std::string, Entry> entries; //Keys start with 'a' for averages and 'f' for frames.
+	std::list<std::string> recently_used; //Most recently used first.
+	std::mutex mutex;
+};
+
+#endif //WARMCACHE_H